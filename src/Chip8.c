@@ -1,417 +1,1865 @@
 #include "Chip8.h"
 #include "Chip8_Macros.h"
+#include "Chip8_Decode.h"
+#include "Chip8_Internal.h"
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <memory.h>
+#include <string.h>
 
-static uint16_t s_opcode;
-static uint8_t s_subInstruction = 0;
-
-#define setBit(A, addr,k)		((A)[addr + (k/8)] |= (1 << (k%8)))
-#define clearBit(A, addr,k)	((A)[addr + (k/8)] &=  ~(1 << (k%8)))
-#define getBit(A, addr,k)		((A)[addr + (k/8)] & (1 << (k%8)))
-
-#define getBit8(A, addr, k)	(A[addr + (k/8)] & (1 << (k%8)))
-
-#define getX() getOpcodeX(s_opcode)
-#define getY() getOpcodeY(s_opcode)
-#define getN() getOpcodeN(s_opcode)
-#define getNN() getOpcodeNN(s_opcode)
-#define getNNN() getOpcodeNNN(s_opcode)
+#define getX() (instruction.x)
+#define getY() (instruction.y)
+#define getN() instructionN(instruction)
+#define getNN() (instruction.nn)
+#define getNNN() instructionNNN(instruction)
 
 #define registerX machine->cpu.reg[getX()]
 #define registerY machine->cpu.reg[getY()]
 #define registerFlag machine->cpu.reg[0xF]
 
-#define VIDEO_MEM_LOCATION 0xF00
-#define CALL_STACK_LOCATION 0xEA0
-#define CODE_START_LOCATION 0x200
-#define FONTSET_LOCATION 0x50
 
 #define FONTSET_SET_SIZE 80
-uint8_t fontset[FONTSET_SET_SIZE] =
-{
-	0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-	0x20, 0x60, 0x20, 0x20, 0x70, // 1
-	0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-	0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-	0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-	0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-	0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-	0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-	0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-	0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-	0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-	0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-	0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-	0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-	0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-	0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+
+//What every machine's memory starts as, shared until it is written.
+static const struct
+{
+	uint8_t below[FONTSET_LOCATION];
+	uint8_t fontset[FONTSET_SET_SIZE];
+	uint8_t above[0x1000 - FONTSET_LOCATION - FONTSET_SET_SIZE];
+} s_blankMemory =
+{
+	{ 0 },
+	{
+		0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+		0x20, 0x60, 0x20, 0x20, 0x70, // 1
+		0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+		0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+		0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+		0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+		0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+		0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+		0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+		0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+		0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+		0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+		0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+		0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+		0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+		0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+	},
+	{ 0 }
 };
 
+//Decoded page of every page with nothing decoded yet, never written.
+static const instruction_t s_blankDecoded[MEMORY_PAGE_SIZE / 2];
 
+struct memoryImage_s
+{
+	uint8_t memory[0x1000];
+};
 
+//A page of memory a machine allocated, shared with its clones until
+//one of them writes to it. Freed when the last one lets go.
+typedef struct page_s
+{
+	long references;
+	uint8_t bytes[MEMORY_PAGE_SIZE];
+} page_t;
+
+#define pageOf(memory) ((page_t*)((uint8_t*)(memory) - offsetof( page_t, bytes )))
+
+
+
+
+typedef void (*INSTRUCTION)(chip8_t*, instruction_t);
+
+
+static void OPDECODE( chip8_t* machine, instruction_t instruction );
+static void OPNOP( chip8_t* machine, instruction_t instruction );
+static void OP00E0( chip8_t* machine, instruction_t instruction );
+static void OP00EE( chip8_t* machine, instruction_t instruction );
+static void OP1NNN( chip8_t* machine, instruction_t instruction );
+static void OP2NNN( chip8_t* machine, instruction_t instruction );
+static void OP3XNN( chip8_t* machine, instruction_t instruction );
+static void OP4XNN( chip8_t* machine, instruction_t instruction );
+static void OP5XY0( chip8_t* machine, instruction_t instruction );
+static void OP6XNN( chip8_t* machine, instruction_t instruction );
+static void OP7XNN( chip8_t* machine, instruction_t instruction );
+static void OP8XY0( chip8_t* machine, instruction_t instruction );
+static void OP8XY1( chip8_t* machine, instruction_t instruction );
+static void OP8XY2( chip8_t* machine, instruction_t instruction );
+static void OP8XY3( chip8_t* machine, instruction_t instruction );
+static void OP8XY4( chip8_t* machine, instruction_t instruction );
+static void OP8XY5( chip8_t* machine, instruction_t instruction );
+static void OP8XY6( chip8_t* machine, instruction_t instruction );
+static void OP8XY7( chip8_t* machine, instruction_t instruction );
+static void OP8XYE( chip8_t* machine, instruction_t instruction );
+static void OP9XY0( chip8_t* machine, instruction_t instruction );
+static void OPANNN( chip8_t* machine, instruction_t instruction );
+static void OPBNNN( chip8_t* machine, instruction_t instruction );
+static void OPCXNN( chip8_t* machine, instruction_t instruction );
+static void OPDXYN( chip8_t* machine, instruction_t instruction );
+static void OPEX9E( chip8_t* machine, instruction_t instruction );
+static void OPEXA1( chip8_t* machine, instruction_t instruction );
+static void OPFX07( chip8_t* machine, instruction_t instruction );
+static void OPFX0A( chip8_t* machine, instruction_t instruction );
+static void OPFX15( chip8_t* machine, instruction_t instruction );
+static void OPFX18( chip8_t* machine, instruction_t instruction );
+static void OPFX1E( chip8_t* machine, instruction_t instruction );
+static void OPFX29( chip8_t* machine, instruction_t instruction );
+static void OPFX33( chip8_t* machine, instruction_t instruction );
+static void OPFX55( chip8_t* machine, instruction_t instruction );
+static void OPFX65( chip8_t* machine, instruction_t instruction );
+
+//Quirk variants.
+static void OP8XY6_VY( chip8_t* machine, instruction_t instruction );
+static void OP8XYE_VY( chip8_t* machine, instruction_t instruction );
+static void OPBXNN( chip8_t* machine, instruction_t instruction );
+static void OPDXYN_CLIP( chip8_t* machine, instruction_t instruction );
+static void OPFX55_PTR( chip8_t* machine, instruction_t instruction );
+static void OPFX65_PTR( chip8_t* machine, instruction_t instruction );
+
+static inline void drawSprite( chip8_t* machine, uint8_t x, uint8_t y, uint8_t n, bool clip );
+static instruction_t fuseInstruction( chip8_t* machine, instruction_t instruction );
+static int runFused( chip8_t* machine, instruction_t instruction );
+static int findIdleTurn( chip8_t* machine, uint8_t value, int limit );
+static bool anyKeyDown( chip8_t* machine );
+static int skipHaltLoop( chip8_t* machine, int count, bool* halted );
+static int findHaltLoop( chip8_t* machine );
+static bool runHaltTurn( chip8_t* machine, int length, int* ran, int* cost );
+static void setupMachine( chip8_t* machine );
+static void shareMemory( chip8_t* machine, const uint8_t* image );
+static void releasePages( chip8_t* machine );
+static void dropPage( page_t* page );
+static void* allocateAligned( size_t size );
+static void freeAligned( void* pointer );
+
+#define QUIRK_PROFILE_LIST(X) \
+	X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7) \
+	X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15)
+
+#define DECLARE_THREADED(quirks) static void runThreaded##quirks( chip8_t* machine, int count );
+QUIRK_PROFILE_LIST( DECLARE_THREADED )
+
+//Everything that changes with the quirks, picked once by setQuirks.
+//The fused sequences at the end of the handlers run their first
+//instruction when they are run on their own.
+typedef struct profile_s
+{
+	INSTRUCTION handlers[OP_COUNT]; //Indexed by operation_t.
+	void (*runThreaded)( chip8_t* machine, int count );
+} profile_t;
+
+#define PROFILE(quirks) { { \
+	OPDECODE,OPNOP,OP00E0,OP00EE,OP1NNN,OP2NNN, \
+	OP3XNN,OP4XNN,OP5XY0,OP6XNN,OP7XNN,OP8XY0, \
+	OP8XY1,OP8XY2,OP8XY3,OP8XY4,OP8XY5, \
+	(quirks) & QUIRK_SHIFT_VY ? OP8XY6_VY : OP8XY6, \
+	OP8XY7, \
+	(quirks) & QUIRK_SHIFT_VY ? OP8XYE_VY : OP8XYE, \
+	OP9XY0,OPANNN, \
+	(quirks) & QUIRK_JUMP_VX ? OPBXNN : OPBNNN, \
+	OPCXNN, \
+	(quirks) & QUIRK_CLIP_SPRITES ? OPDXYN_CLIP : OPDXYN, \
+	OPEX9E,OPEXA1,OPFX07,OPFX0A,OPFX15, \
+	OPFX18,OPFX1E,OPFX29,OPFX33, \
+	(quirks) & QUIRK_INCREMENT_PTR ? OPFX55_PTR : OPFX55, \
+	(quirks) & QUIRK_INCREMENT_PTR ? OPFX65_PTR : OPFX65, \
+	OP6XNN,OPFX07,OP7XNN \
+	}, runThreaded##quirks },
+
+//Indexed by the quirk bits.
+static const profile_t s_profiles[QUIRK_PROFILES] = {
+	QUIRK_PROFILE_LIST( PROFILE )
+};
 
-typedef void (*INSTRUCTION)(chip8_t*);
+static const char* s_quirkNames[] = {
+	"shift",
+	"memory",
+	"clip",
+	"jump"
+};
 
+static const cycleCosts_t s_cycleCosts[] = {
+	{ "uniform", {
+		[OP_NOP] = 1, [OP_00E0] = 1, [OP_00EE] = 1, [OP_1NNN] = 1, [OP_2NNN] = 1, [OP_3XNN] = 1,
+		[OP_4XNN] = 1, [OP_5XY0] = 1, [OP_6XNN] = 1, [OP_7XNN] = 1, [OP_8XY0] = 1, [OP_8XY1] = 1,
+		[OP_8XY2] = 1, [OP_8XY3] = 1, [OP_8XY4] = 1, [OP_8XY5] = 1, [OP_8XY6] = 1, [OP_8XY7] = 1,
+		[OP_8XYE] = 1, [OP_9XY0] = 1, [OP_ANNN] = 1, [OP_BNNN] = 1, [OP_CXNN] = 1, [OP_DXYN] = 1,
+		[OP_EX9E] = 1, [OP_EXA1] = 1, [OP_FX07] = 1, [OP_FX0A] = 1, [OP_FX15] = 1, [OP_FX18] = 1,
+		[OP_FX1E] = 1, [OP_FX29] = 1, [OP_FX33] = 1, [OP_FX55] = 1, [OP_FX65] = 1,
+	}, 0, 0 },
+
+	//Roughly what the COSMAC VIP interpreter takes, in machine cycles
+	//of 8 clocks at 1.76 MHz. Ignores the cycles lost to the display
+	//interrupt, and that skips and FX55/FX65 vary a little.
+	{ "vip", {
+		[OP_NOP] = 10,
+		[OP_00E0] = 3078,
+		[OP_00EE] = 10,
+		[OP_1NNN] = 12,
+		[OP_2NNN] = 26,
+		[OP_3XNN] = 10,
+		[OP_4XNN] = 10,
+		[OP_5XY0] = 14,
+		[OP_6XNN] = 6,
+		[OP_7XNN] = 10,
+		[OP_8XY0] = 44,
+		[OP_8XY1] = 44,
+		[OP_8XY2] = 44,
+		[OP_8XY3] = 44,
+		[OP_8XY4] = 44,
+		[OP_8XY5] = 44,
+		[OP_8XY6] = 44,
+		[OP_8XY7] = 44,
+		[OP_8XYE] = 44,
+		[OP_9XY0] = 14,
+		[OP_ANNN] = 12,
+		[OP_BNNN] = 22,
+		[OP_CXNN] = 36,
+		[OP_DXYN] = 68,
+		[OP_EX9E] = 14,
+		[OP_EXA1] = 14,
+		[OP_FX07] = 10,
+		[OP_FX0A] = 19,
+		[OP_FX15] = 10,
+		[OP_FX18] = 10,
+		[OP_FX1E] = 16,
+		[OP_FX29] = 20,
+		[OP_FX33] = 80,
+		[OP_FX55] = 36,
+		[OP_FX65] = 36,
+	}, 46, 3668 },
+};
 
-static void OP0( chip8_t* machine );
-static void OP1( chip8_t* machine );
-static void OP2( chip8_t* machine );
-static void OP3( chip8_t* machine );
-static void OP4( chip8_t* machine );
-static void OP5( chip8_t* machine );
-static void OP6( chip8_t* machine );
-static void OP7( chip8_t* machine );
-static void OP8( chip8_t* machine );
-static void OP9( chip8_t* machine );
-static void OPA( chip8_t* machine );
-static void OPB( chip8_t* machine );
-static void OPC( chip8_t* machine );
-static void OPD( chip8_t* machine );
-static void OPE( chip8_t* machine );
-static void OPF( chip8_t* machine );
+static const char* s_fusionNames[FUSION_COUNT] = {
+	"6XNN 6YNN DXYN",
+	"FX07 3XNN 1NNN",
+	"7XNN 3XNN 1NNN"
+};
 
 
-static INSTRUCTION s_instructions[16] = {
-	OP0,OP1,OP2,OP3,OP4,OP5,OP6,OP7,
-	OP8,OP9,OPA,OPB,OPC,OPD,OPE,OPF
-};
+//The framebuffer is 32 rows of 8 bytes, with pixel x of a row in bit
+//x % 8 of byte x / 8. Loaded little endian that makes each row a word
+//with pixel x in bit x, and the memory at VIDEO_MEM_LOCATION stays
+//the same for roms and frontends that read it.
+static inline uint64_t loadRow( const uint8_t* video, int y )
+{
+	uint64_t row;
+	memcpy( &row, video + y * 8, sizeof( row ) );
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	row = __builtin_bswap64( row );
+#endif
+	return row;
+}
 
-chip8_t* createMachine()
+static inline void storeRow( uint8_t* video, int y, uint64_t row )
+{
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	row = __builtin_bswap64( row );
+#endif
+	memcpy( video + y * 8, &row, sizeof( row ) );
+}
+
+//The framebuffer page, copied first if it is still shared.
+static inline uint8_t* videoMemory( chip8_t* machine )
 {
+	uint8_t page = VIDEO_MEM_LOCATION >> 8;
 
-	chip8_t* machine = malloc( sizeof( chip8_t ) );
+	if ( machine->sharedPages & (1u << page) && ! ownPage( machine, page ) )
+		return NULL;
 
-	if ( machine )
+	machine->dirtyPages |= 1u << page;
+	return machine->pages[page];
+}
+
+static inline void clearScreen( chip8_t* machine )
+{
+	uint8_t* video = videoMemory( machine );
+
+	if ( video )
 	{
-		memset( machine->cpu.reg, 0x0, 16 );
-		machine->cpu.dly = 0;
-		machine->cpu.snd = 0;
-		machine->cpu.ptr = 0;
-		machine->cpu.pc = CODE_START_LOCATION;
-		machine->cpu.sp = CALL_STACK_LOCATION;
-		memset( machine->memory, 0x0, 0x1000 );
-		memset( machine->memory + VIDEO_MEM_LOCATION, 0x0, 256 );
-		memset( machine->memory + KEY_LOCATION, 0x0, NUM_KEYS );
-		memcpy( machine->memory + FONTSET_LOCATION, fontset, FONTSET_SET_SIZE );
+		//Only rows with something on them change.
+		for ( int row = 0; row < 32; row++ )
+			machine->dirtyRows |= (uint32_t)(loadRow( video, row ) != 0) << row;
+
+		memset( video, 0x0, 256 );
 	}
 
-	
+	invalidateDecoded( machine, VIDEO_MEM_LOCATION, 256 );
+}
 
-	return machine;
+//The return address is stored little endian on the call stack.
+static inline void pushReturn( chip8_t* machine )
+{
+	machine->cpu.sp += 2;
+	storeByte( machine, machine->cpu.sp, machine->cpu.pc & 0xFF );
+	storeByte( machine, machine->cpu.sp + 1, machine->cpu.pc >> 8 );
 }
 
-uint8_t* readCode( const char* filename, int* len )
+static inline void popReturn( chip8_t* machine )
 {
-	FILE* file;
-	file = fopen( filename, "rb" );
+	machine->cpu.pc = loadByte( machine, machine->cpu.sp ) | (loadByte( machine, machine->cpu.sp + 1 ) << 8);
+	machine->cpu.sp -= 2;
+}
 
-	if ( ! file )
+static inline void storeBCD( chip8_t* machine, uint8_t value )
+{
+	storeByte( machine, machine->cpu.ptr + 2, value % 10 );
+	value /= 10;
+
+	storeByte( machine, machine->cpu.ptr + 1, value % 10 );
+	value /= 10;
+
+	storeByte( machine, machine->cpu.ptr, value % 10 );
+}
+
+static inline void storeRegisters( chip8_t* machine, uint8_t last )
+{
+	for ( int i = 0; i <= last; i++ )
 	{
-		fprintf( stderr, "ERROR: Could not open file.\n" );
-		return NULL;
+		storeByte( machine, machine->cpu.ptr + i, machine->cpu.reg[i] );
 	}
+}
 
-	unsigned char* buffer = malloc( 0x800 );
-
-	if ( ! buffer )
+static inline void loadRegisters( chip8_t* machine, uint8_t last )
+{
+	for ( int i = 0; i <= last; i++ )
 	{
-		fprintf( stderr, "ERROR: Could not create buffer.\n" );
-		fclose( file );
-		return buffer;
+		machine->cpu.reg[i] = loadByte( machine, machine->cpu.ptr + i );
 	}
+}
 
-	*len = fread( buffer, 1, 0x800, file );
-	fclose( file );
+chip8_t* createMachine()
+{
+	buildDecodeTable();
 
-	return buffer;
+	chip8_t* machine = allocateAligned( sizeof( chip8_t ) );
+
+	if ( machine )
+		setupMachine( machine );
+
+	return machine;
 }
 
-bool loadRom( uint8_t* memory, const char* filename )
+//Everything that doesn't start at 0, the rest is already cleared.
+static void setupMachine( chip8_t* machine )
 {
-	int len;
+	machine->cpu.pc = CODE_START_LOCATION;
+	machine->cpu.sp = CALL_STACK_LOCATION;
+	machine->timerClocks = TIMER_CLOCKS;
+	machine->interpreter = INTERPRETER_TABLE;
+	shareMemory( machine, (const uint8_t*)&s_blankMemory );
+	seedMachine( machine, DEFAULT_SEED );
+	machine->costs = &s_cycleCosts[0];
+	machine->profile = &s_profiles[0];
+}
 
-	uint8_t* code = readCode( filename, &len );
+void resetMachine( chip8_t* machine )
+{
+	bool inArena = machine->inArena;
+	destroyBlockCache( machine );
+	releasePages( machine );
+	memset( machine, 0x0, sizeof( chip8_t ) );
+	machine->inArena = inArena;
+	setupMachine( machine );
+}
 
-	if ( code )
+//Shared pages aren't counted, they belong to an image or are split with clones.
+size_t machineFootprint( const chip8_t* machine )
+{
+	size_t bytes = sizeof( chip8_t ) + blockCacheFootprint( machine ) + spriteCacheFootprint( machine );
+
+	for ( int page = 0; page < MEMORY_PAGES; page++ )
 	{
-		memcpy( memory, code, len );
-		free( code );
-		return true;
+		if ( ! (machine->sharedPages & (1u << page)) )
+			bytes += sizeof( page_t );
+
+		if ( machine->decodedPages & (1u << page) )
+			bytes += sizeof( s_blankDecoded );
 	}
 
-	return false;
+	return bytes;
 }
 
-bool peekCall( chip8_t* machine )
+//Points every page of memory at image, and every decoded page at
+//the blank one. The machine mustn't have any pages of its own.
+static void shareMemory( chip8_t* machine, const uint8_t* image )
 {
-	return getOpcodeUpper( getOpcode( machine, machine->cpu.pc ) ) == 0x2;
+	for ( int page = 0; page < MEMORY_PAGES; page++ )
+	{
+		machine->pages[page] = (uint8_t*)image + page * MEMORY_PAGE_SIZE;
+		machine->decoded[page] = (instruction_t*)s_blankDecoded;
+	}
+
+	machine->sharedPages = ALL_PAGES;
+	machine->decodedPages = 0;
+	machine->dirtyPages = ALL_PAGES;
+	machine->dirtyRows = ALL_ROWS;
 }
 
-void doOneClock( chip8_t* machine )
+//Lets go of the pages the machine allocated or shares with clones,
+//leaving them pointing at nothing until shareMemory.
+static void releasePages( chip8_t* machine )
 {
-	s_subInstruction = (s_subInstruction + 1) % 3;
+	for ( int page = 0; page < MEMORY_PAGES; page++ )
+	{
+		if ( machine->allocatedPages & (1u << page) )
+			dropPage( pageOf( machine->pages[page] ) );
 
-	static int counter = 0;
-	counter = (counter + 1) % 10;
+		if ( machine->decodedPages & (1u << page) )
+			free( machine->decoded[page] );
+	}
 
-	machine->cpu.dly -= machine->cpu.dly != 0 && counter == 0;
-	machine->cpu.snd -= machine->cpu.snd != 0 && counter == 0;
+	machine->sharedPages = ALL_PAGES;
+	machine->allocatedPages = 0;
+	machine->decodedPages = 0;
 
-	switch ( s_subInstruction )
-	{
-	case 0:
-		machine->cpu.pc += 2;
-		break;
-	case 1:
-		s_opcode = getOpcode( machine, machine->cpu.pc );
-		break;
-	case 2:
-		s_instructions[getOpcodeUpper(s_opcode)]( machine );
-	}
+	//Cached sprites were read from the pages.
+	destroySpriteCache( machine );
 }
 
-void doOneClockDebug( chip8_t* machine, chip8_t* prevMachine )
+static void dropPage( page_t* page )
 {
-	memcpy( prevMachine, machine, sizeof( chip8_t ) );
-	doOneClock( machine );
+	if ( atomicDecrement( &page->references ) == 0 )
+		free( page );
 }
 
-void doOneInstructionDebug( chip8_t* machine, chip8_t* prevMachine )
+bool ownPage( chip8_t* machine, uint8_t page )
 {
-	memcpy( prevMachine, machine, sizeof( chip8_t ) );
+	page_t* shared = NULL;
 
-	do
+	if ( machine->allocatedPages & (1u << page) )
 	{
-		doOneClock( machine );
-	} while ( s_subInstruction != 0 );
+		shared = pageOf( machine->pages[page] );
+
+		//Every clone that shared it has since let go.
+		if ( atomicLoad( &shared->references ) == 1 )
+		{
+			machine->sharedPages &= ~(1u << page);
+			return true;
+		}
+	}
+
+	page_t* copy = malloc( sizeof( page_t ) );
+
+	if ( ! copy )
+		return false;
+
+	copy->references = 1;
+	memcpy( copy->bytes, machine->pages[page], MEMORY_PAGE_SIZE );
+
+	if ( shared )
+		dropPage( shared );
+
+	machine->pages[page] = copy->bytes;
+	machine->sharedPages &= ~(1u << page);
+	machine->allocatedPages |= 1u << page;
+	return true;
 }
 
-void destroyMachine( chip8_t* machine )
+chip8_t* cloneMachine( chip8_t* machine )
 {
-	free( machine );
+	chip8_t* clone = allocateAligned( sizeof( chip8_t ) );
+
+	if ( clone )
+		copyMachine( clone, machine );
+
+	return clone;
 }
 
-void OP0( chip8_t* machine )
+//Both machines end up sharing every page, so whichever writes one
+//first copies it.
+void copyMachine( chip8_t* target, chip8_t* machine )
 {
-	if ( getN() == 0 )
-	{
-		//Clear display
-		memset( machine->memory + VIDEO_MEM_LOCATION, 0x0, 256 );
-	}
-	else if ( getN() == 0xE )
+	bool inArena = target->inArena;
+	destroyBlockCache( target );
+	releasePages( target );
+
+	for ( int page = 0; page < MEMORY_PAGES; page++ )
 	{
-		//Return from routine.
-		machine->cpu.pc = *(uint16_t*)(machine->memory + machine->cpu.sp);
-		machine->cpu.sp -= 2;
+		if ( machine->allocatedPages & (1u << page) )
+			atomicIncrement( &pageOf( machine->pages[page] )->references );
 	}
-}
 
-void OP1( chip8_t* machine )
-{
-	machine->cpu.pc = getNNN() - 2;
+	machine->sharedPages = ALL_PAGES;
+	memcpy( target, machine, sizeof( chip8_t ) );
+	target->blocks = NULL;
+	target->sprites = NULL;
+	target->spritePages = 0;
+	target->dirtyRows = ALL_ROWS;
+	target->inArena = inArena;
+	target->decodedPages = 0;
+
+	for ( int page = 0; page < MEMORY_PAGES; page++ )
+		target->decoded[page] = (instruction_t*)s_blankDecoded;
 }
 
-void OP2( chip8_t* machine )
+bool ownDecodedPage( chip8_t* machine, uint8_t page )
 {
-	machine->cpu.sp += 2;
-	*(uint16_t*)(machine->memory + machine->cpu.sp) = machine->cpu.pc;
-	machine->cpu.pc = getNNN() - 2;
+	instruction_t* decoded = calloc( 1, sizeof( s_blankDecoded ) );
+
+	if ( ! decoded )
+		return false;
+
+	machine->decoded[page] = decoded;
+	machine->decodedPages |= 1u << page;
+	return true;
 }
 
-void OP3( chip8_t* machine )
+memoryImage_t* createMemoryImage( const chip8_t* machine )
 {
-	machine->cpu.pc += (registerX == getNN()) * 2;
+	memoryImage_t* image = malloc( sizeof( memoryImage_t ) );
+
+	if ( ! image )
+		return NULL;
+
+	for ( int page = 0; page < MEMORY_PAGES; page++ )
+		memcpy( image->memory + page * MEMORY_PAGE_SIZE, machine->pages[page], MEMORY_PAGE_SIZE );
+
+	return image;
 }
 
-void OP4( chip8_t* machine )
+void shareMemoryImage( chip8_t* machine, const memoryImage_t* image )
 {
-	machine->cpu.pc += (registerX != getNN()) * 2;
+	destroyBlockCache( machine );
+	releasePages( machine );
+	shareMemory( machine, image->memory );
 }
 
-void OP5( chip8_t* machine )
+void destroyMemoryImage( memoryImage_t* image )
 {
-	machine->cpu.pc += (registerX == registerY) * 2;
+	free( image );
 }
 
-void OP6( chip8_t* machine )
+uint8_t readMemory( chip8_t* machine, uint16_t address )
 {
-	registerX = getNN();
+	return loadByte( machine, address );
 }
 
-void OP7( chip8_t* machine )
+void writeMemory( chip8_t* machine, uint16_t address, uint8_t value )
 {
-	registerX += getNN();
+	storeByte( machine, address, value );
 }
 
-void OP8( chip8_t* machine )
+void loadMemory( chip8_t* machine, uint16_t address, const uint8_t* data, uint16_t length )
 {
-	uint16_t sum;
-	switch ( getN() )
+	for ( uint16_t i = 0; i < length; )
 	{
-	case 0x0:
-		registerX = registerY;
-		break;
-	case 0x1:
-		registerX |= registerY;
-		break;
-	case 0x2:
-		registerX &= registerY;
-		break;
-	case 0x3:
-		registerX ^= registerY;
-		break;
-	case 0x4:
-		sum = registerX + registerY;
-		registerFlag = (sum & 0xFF00u) != 0;
-		registerX = sum;
-		break;
-	case 0x5:
-		sum = registerX - registerY;
-		registerFlag = (sum & 0xFF00u) != 0;
-		registerX = sum;
-		break;
-	case 0x6:
-		registerFlag = (0x1u & registerX);
-		registerX >>= 1;
-		break;
-	case 0x7:
-		sum = registerY - registerX;
-		registerFlag = (sum & 0xFF00u) != 0;
-		registerX = sum;
-		break;
-	case 0xE:
-		registerFlag = (0x10000000u & registerX) != 0;
-		registerX <<= 1;
-		break;
+		uint16_t masked = (address + i) & ADDRESS_MASK;
+		uint8_t page = masked >> 8;
+		uint16_t offset = masked & 0xFF;
+		uint16_t room = MEMORY_PAGE_SIZE - offset;
+		uint16_t left = length - i;
+		uint16_t count = room < left ? room : left;
+
+		if ( ! (machine->sharedPages & (1u << page)) || ownPage( machine, page ) )
+		{
+			memcpy( machine->pages[page] + offset, data + i, count );
+			machine->dirtyPages |= 1u << page;
+
+			if ( page == VIDEO_MEM_LOCATION >> 8 )
+				machine->dirtyRows |= ((2u << ((offset + count - 1) >> 3)) - 1) & ~((1u << (offset >> 3)) - 1);
+		}
+
+		i += count;
 	}
+
+	invalidateDecoded( machine, address, length );
 }
 
-void OP9( chip8_t* machine )
+void invalidateDecoded( chip8_t* machine, uint16_t address, uint16_t length )
 {
-	machine->cpu.pc += (registerX != registerY) * 2;
+	bool touched = false;
+
+	//A fused instruction starts up to two instructions back.
+	uint16_t first = (address & ADDRESS_MASK) >> 1;
+	if ( machine->decodedPages & (1u << (first >> 7)) )
+	{
+		forgetDecoded( machine, first - 1 );
+		forgetDecoded( machine, first - 2 );
+	}
+
+	for ( uint32_t i = address & ~1u; i < (uint32_t)address + length; i += 2 )
+	{
+		uint16_t masked = i & ADDRESS_MASK;
+		if ( ! (machine->decodedPages & (1u << (masked >> 8))) )
+		{
+			//Nothing decoded in this page, skip to the next one.
+			i = (i | 0xFF) - 1;
+			continue;
+		}
+
+		machine->decoded[masked >> 8][(masked & 0xFF) >> 1].operation = OP_DECODE;
+		touched = true;
+	}
+
+	//Blocks are only built from decoded instructions.
+	if ( touched && machine->blocks )
+		invalidateBlocks( machine, address, length );
+
+	if ( machine->spritePages )
+		invalidateSprites( machine, address, length );
 }
 
-void OPA( chip8_t* machine )
+uint8_t* readCode( const char* filename, int* len )
 {
-	machine->cpu.ptr = getNNN();
+	FILE* file;
+	file = fopen( filename, "rb" );
+
+	if ( ! file )
+	{
+		fprintf( stderr, "ERROR: Could not open file.\n" );
+		return NULL;
+	}
+
+	unsigned char* buffer = malloc( 0x800 );
+
+	if ( ! buffer )
+	{
+		fprintf( stderr, "ERROR: Could not create buffer.\n" );
+		fclose( file );
+		return buffer;
+	}
+
+	*len = fread( buffer, 1, 0x800, file );
+	fclose( file );
+
+	return buffer;
 }
 
-void OPB( chip8_t* machine )
+bool loadRom( chip8_t* machine, const char* filename )
 {
-	machine->cpu.pc = getNNN() + machine->cpu.reg[0] - 2;
+	int len;
+
+	uint8_t* code = readCode( filename, &len );
+
+	if ( code )
+	{
+		loadMemory( machine, CODE_START_LOCATION, code, len );
+		free( code );
+		return true;
+	}
+
+	return false;
 }
 
-void OPC( chip8_t* machine )
+bool peekCall( chip8_t* machine )
 {
-	uint8_t num = rand() & 0xFF;
-	registerX = num & getNN();
+	return getOpcodeUpper( getOpcode( machine, machine->cpu.pc ) ) == 0x2;
 }
 
-void OPD( chip8_t* machine )
+void runTable( chip8_t* machine, int count )
 {
-	uint8_t x = registerX;
-	uint8_t y = registerY;
-	uint8_t n = getN();
+	const INSTRUCTION* handlers = machine->profile->handlers;
 
-	registerFlag = 0;
-
-	uint16_t size = n * 8;
-	for ( int i = 0; i < size; i++ )
+	for ( int i = 0; i < count; i++ )
 	{
-		if ( getBit( machine->memory, machine->cpu.ptr, i ) )
-		{
-			uint16_t xcoord = x + 7 - (i % 8);
-			uint16_t ycoord = y + (i / 8);
+		//Same timing as the three clocks of doOneClock:
+		//fetch and execute, then advance.
+		instruction_t instruction = fetchInstruction( machine, machine->cpu.pc );
 
-			xcoord = xcoord % 64;
-			ycoord = ycoord % 32;
+		if ( instruction.operation >= OP_FIRST_FUSED && count - i >= FUSED_LENGTH )
+		{
+			//Idle loops waiting on 3XNN are fused into timer polls, so
+			//only those are checked, before any clock of the turn.
+			int skipped = instruction.operation == OP_FUSED_TIMER_POLL ? skipIdleLoop( machine, count - i ) : 0;
 
-			int index = xcoord + ycoord * 64;
-			//int index = x + (i % 8) + (y + (i/8)) * 64;
-			if ( getBit( machine->memory, VIDEO_MEM_LOCATION, index ) )
+			if ( skipped )
 			{
-				clearBit( machine->memory, VIDEO_MEM_LOCATION, index );
-				registerFlag = 1;
+				i += skipped - 1;
+				continue;
 			}
-			else
-				setBit( machine->memory, VIDEO_MEM_LOCATION, index );
+
+			advanceTimers( machine, 2 );
+			i += runFused( machine, instruction );
+		}
+		else
+		{
+			advanceTimers( machine, 2 );
+			handlers[instruction.operation]( machine, instruction );
 		}
-	}
 
+		advanceTimers( machine, 1 );
+		machine->cpu.pc += 2;
+	}
 }
 
-void OPE( chip8_t* machine )
+static void runInterpreter( chip8_t* machine, int count )
 {
-	if ( getN() == 0xE )
-	{
-		machine->cpu.pc += (machine->memory[KEY_LOCATION + registerX] == 1) * 2;
-
-	}
-	else if ( getN() == 0x1 )
+	switch ( machine->interpreter )
 	{
-		machine->cpu.pc += (machine->memory[KEY_LOCATION + registerX] == 0) * 2 ;
+	case INTERPRETER_THREADED:
+		machine->profile->runThreaded( machine, count );
+		break;
+	case INTERPRETER_BLOCK:
+	case INTERPRETER_JIT:
+		runBlocks( machine, count );
+		break;
+	default:
+		runTable( machine, count );
+		break;
 	}
-	
 }
 
-void OPF( chip8_t* machine )
+//Compiled code hands back anything it can't run (code it never saw,
+//code that has been written over) one instruction at a time.
+static void runCompiled( chip8_t* machine, int count )
 {
-	switch ( getNN() )
+	while ( count > 0 )
 	{
-	case 0x07:
-		registerX = machine->cpu.dly;
-		return;
-	case 0x0A:
-		for ( int i = 0; i < NUM_KEYS; i++ )
+		count -= machine->compiled( machine, count );
+
+		if ( count > 0 )
 		{
-			if ( machine->memory[KEY_LOCATION + i] )
-			{
-				registerX = machine->memory[KEY_LOCATION + i];
-				return;
-			}
+			runInterpreter( machine, 1 );
+			count--;
 		}
-		machine->cpu.pc -= 2; //wait
-		return;
+	}
+}
 
-	case 0x15:
-		machine->cpu.dly = registerX;
-		return;
-	case 0x18:
-		machine->cpu.snd = registerX;
-		return;
-	case 0x1E:
-		machine->cpu.ptr += registerX;
-		return;
-	case 0x29:
-		machine->cpu.ptr = FONTSET_LOCATION + (5 * registerX);
-		return;
-	case 0x33:
-	{
-		uint8_t value = registerX;
-		machine->memory[machine->cpu.ptr + 2] = value % 10;
-		value /= 10;
+runStatus_t runInstructions( chip8_t* machine, int count )
+{
+	//Finish off any instruction the debugger left part way through.
+	while ( machine->subInstruction != 0 )
+		doOneClock( machine );
 
-		machine->memory[machine->cpu.ptr + 1] = value % 10;
-		value /= 10;
+	//Each interpreter also looks for idle loops as it runs, this
+	//catches one that the last call stopped at the start of.
+	bool halted;
+	count -= skipKeyWait( machine, count );
+	count -= skipHaltLoop( machine, count, &halted );
+	count -= skipIdleLoop( machine, count );
 
-		machine->memory[machine->cpu.ptr] = value % 10;
-		return;
-	}
-	case 0x55:
-		for ( int i = 0; i <= getX(); i++ )
+	if ( machine->compiled && machine->compiledQuirks == machine->quirks )
+		runCompiled( machine, count );
+	else
+		runInterpreter( machine, count );
+
+	if ( halted )
+		return RUN_HALTED;
+
+	return machine->waitingForKey ? RUN_WAITING : RUN_ACTIVE;
+}
+
+//Two machines ahead the lines from the start of the machine up to its
+//compiled rom are fetched, one ahead the code and decoded
+//instruction at its pc. By the time a machine runs, everything it
+//needs to get going should already be in cache.
+int stepMany( chip8_t** machines, int count, int instructions )
+{
+	int active = 0;
+
+	for ( int i = 0; i < count; i++ )
+	{
+		if ( i + 2 < count )
 		{
-			machine->memory[machine->cpu.ptr + i] = machine->cpu.reg[i];
+			const uint8_t* state = (const uint8_t*)machines[i + 2];
+
+			for ( size_t line = 0; line <= offsetof( chip8_t, compiled ); line += CACHE_LINE )
+				prefetch( state + line );
 		}
-		return;
-	case 0x65:
-		for ( int i = 0; i <= getX(); i++ )
+
+		if ( i + 1 < count )
 		{
-			machine->cpu.reg[i] = machine->memory[machine->cpu.ptr + i];
+			chip8_t* next = machines[i + 1];
+			uint16_t pc = next->cpu.pc & ADDRESS_MASK;
+			prefetch( next->pages[pc >> 8] + (pc & 0xFF) );
+			prefetch( next->decoded[pc >> 8] + ((pc & 0xFF) >> 1) );
 		}
-		return;
+
+		active += runInstructions( machines[i], instructions ) == RUN_ACTIVE;
 	}
+
+	return active;
+}
+
+//A loop at the pc of at most HALT_LOOP_LENGTH instructions, reading
+//nothing but the registers and code, that jumps back to the pc. Skips
+//may leave it. One turn is run, and if that puts the registers back
+//as they were every turn after will too. The rest of the count is
+//then only ticking the timers, apart from a part turn at the end.
+int skipHaltLoop( chip8_t* machine, int count, bool* halted )
+{
+	*halted = false;
+
+	int length = findHaltLoop( machine );
+
+	if ( length == 0 || count < length * 2 )
+		return 0;
+
+	int ran = 0;
+	int cost = 0;
+
+	if ( ! runHaltTurn( machine, length, &ran, &cost ) )
+		return ran;
+
+	*halted = true;
+
+	int turns = (count - ran) / ran;
+	skipTimers( machine, turns * ran * 3 );
+	return ran + turns * ran;
+}
+
+//Modeled cycles of an instruction under the costs.
+static inline int instructionCost( const cycleCosts_t* costs, instruction_t instruction )
+{
+	int cost = costs->operations[instruction.operation];
+
+	if ( instruction.operation == OP_DXYN )
+		cost += costs->spriteRow * instructionN( instruction );
+
+	return cost;
 }
 
+//Runs one turn of the loop findHaltLoop found at the pc, counting the
+//instructions in ran and their modeled cycles in cost. True when the
+//turn left the registers as they were, so every turn after will too.
+static bool runHaltTurn( chip8_t* machine, int length, int* ran, int* cost )
+{
+	cpu_t before = machine->cpu;
+
+	do
+	{
+		instruction_t instruction = decodeInstruction( getOpcode( machine, machine->cpu.pc ) );
+		advanceTimers( machine, 2 );
+		executeInstruction( machine, instruction );
+		advanceTimers( machine, 1 );
+		machine->cpu.pc += 2;
+		*ran += 1;
+		*cost += instructionCost( machine->costs, instruction );
+	} while ( (uint16_t)(machine->cpu.pc - before.pc) < length * 2 && machine->cpu.pc != before.pc );
+
+	return machine->cpu.pc == before.pc && machine->cpu.sp == before.sp && machine->cpu.ptr == before.ptr
+		&& memcmp( machine->cpu.reg, before.reg, sizeof( before.reg ) ) == 0;
+}
+
+//Length of the loop at the pc for skipHaltLoop, 0 if there isn't one.
+int findHaltLoop( chip8_t* machine )
+{
+	uint16_t pc = machine->cpu.pc;
+
+	for ( int i = 0; i < HALT_LOOP_LENGTH; i++ )
+	{
+		instruction_t instruction = decodeInstruction( getOpcode( machine, pc + i * 2 ) );
+
+		switch ( instruction.operation )
+		{
+		case OP_1NNN:
+			return instructionNNN( instruction ) == pc ? i + 1 : 0;
+		case OP_FX07:
+			//Only once the delay timer has stopped.
+			if ( machine->cpu.dly != 0 )
+				return 0;
+			break;
+		case OP_NOP:
+		case OP_3XNN:
+		case OP_4XNN:
+		case OP_5XY0:
+		case OP_6XNN:
+		case OP_7XNN:
+		case OP_8XY0:
+		case OP_8XY1:
+		case OP_8XY2:
+		case OP_8XY3:
+		case OP_8XY4:
+		case OP_8XY5:
+		case OP_8XY6:
+		case OP_8XY7:
+		case OP_8XYE:
+		case OP_9XY0:
+		case OP_ANNN:
+		case OP_FX1E:
+		case OP_FX29:
+			break;
+		default:
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+//FX0A repeats until a key is down, which only ticks the timers. The
+//flag is only trusted with FX0A still at the pc, in case the debugger
+//or a pool has moved it since.
+int skipKeyWait( chip8_t* machine, int count )
+{
+	if ( ! machine->waitingForKey || count <= 0 )
+		return 0;
+
+	if ( (getOpcode( machine, machine->cpu.pc ) & 0xF0FF) != 0xF00A || anyKeyDown( machine ) )
+	{
+		machine->waitingForKey = false;
+		return 0;
+	}
+
+	skipTimers( machine, count * 3 );
+	return count;
+}
+
+//An idle loop polls the delay timer until it reads a value, and does
+//nothing else:
+//	FX07, then 3XNN or 4XNN on the same VX, then 1NNN back to the FX07.
+//The value read only ever goes down, so a binary search finds the
+//first turn around the loop that would read a value that leaves it.
+//Every turn before that is skipped by ticking the timers forward.
+int skipIdleLoop( chip8_t* machine, int count )
+{
+	uint16_t pc = machine->cpu.pc;
+
+	if ( count < IDLE_LOOP_LENGTH || (getOpcode( machine, pc ) & 0xF0FF) != 0xF007 )
+		return 0;
+
+	instruction_t poll = decodeInstruction( getOpcode( machine, pc ) );
+	instruction_t test = decodeInstruction( getOpcode( machine, pc + 2 ) );
+	instruction_t jump = decodeInstruction( getOpcode( machine, pc + 4 ) );
+
+	if ( (test.operation != OP_3XNN && test.operation != OP_4XNN) || test.x != poll.x
+		|| jump.operation != OP_1NNN || instructionNNN( jump ) != pc )
+		return 0;
+
+	int turns = count / IDLE_LOOP_LENGTH;
+	uint8_t value = test.nn;
+
+	//3XNN leaves on reading NN, which a value already below it never
+	//will. With ticks closer together than a turn the reads can also
+	//step over it. 4XNN leaves on reading anything else.
+	if ( test.operation == OP_3XNN )
+	{
+		int leave = findIdleTurn( machine, value, turns );
+
+		if ( leave < turns && delayAfter( machine, leave * IDLE_LOOP_CLOCKS + 2 ) == value )
+			turns = leave;
+	}
+	else if ( delayAfter( machine, 2 ) != value )
+		turns = 0;
+	else if ( value > 0 )
+		turns = findIdleTurn( machine, value - 1, turns );
+
+	if ( turns == 0 )
+		return 0;
+
+	//VX is left as the last skipped turn read it.
+	skipTimers( machine, (turns - 1) * IDLE_LOOP_CLOCKS + 2 );
+	machine->cpu.reg[poll.x] = machine->cpu.dly;
+	skipTimers( machine, IDLE_LOOP_CLOCKS - 2 );
+
+	machine->idleSkipped += turns * IDLE_LOOP_LENGTH;
+	return turns * IDLE_LOOP_LENGTH;
+}
+
+bool anyKeyDown( chip8_t* machine )
+{
+	for ( int i = 0; i < NUM_KEYS; i++ )
+	{
+		if ( loadByte( machine, KEY_LOCATION + i ) )
+			return true;
+	}
+	return false;
+}
+
+//First turn around an idle loop, up to limit, whose FX07 reads at
+//most value.
+int findIdleTurn( chip8_t* machine, uint8_t value, int limit )
+{
+	int low = 0;
+	int high = limit;
+
+	while ( low < high )
+	{
+		int middle = low + (high - low) / 2;
+
+		if ( delayAfter( machine, middle * IDLE_LOOP_CLOCKS + 2 ) <= value )
+			high = middle;
+		else
+			low = middle + 1;
+	}
+
+	return low;
+}
+
+void setCompiledRom( chip8_t* machine, compiledRom_t rom, uint8_t quirks )
+{
+	machine->compiled = rom;
+	machine->compiledQuirks = quirks;
+}
+
+void setTimerClocks( chip8_t* machine, uint8_t clocks )
+{
+	if ( clocks != TIMER_FRAME && clocks < MIN_TIMER_CLOCKS )
+		clocks = MIN_TIMER_CLOCKS;
+	else if ( clocks > MAX_TIMER_CLOCKS )
+		clocks = MAX_TIMER_CLOCKS;
+
+	machine->timerClocks = clocks;
+	machine->timerCounter = 0;
+}
+
+void tickTimers( chip8_t* machine )
+{
+	machine->cpu.dly -= machine->cpu.dly != 0;
+	machine->cpu.snd -= machine->cpu.snd != 0;
+}
+
+const cycleCosts_t* findCycleCosts( const char* name )
+{
+	for ( size_t i = 0; i < sizeof( s_cycleCosts ) / sizeof( s_cycleCosts[0] ); i++ )
+	{
+		if ( strcmp( name, s_cycleCosts[i].name ) == 0 )
+			return &s_cycleCosts[i];
+	}
+
+	return NULL;
+}
+
+void setCycleCosts( chip8_t* machine, const cycleCosts_t* costs )
+{
+	machine->costs = costs ? costs : &s_cycleCosts[0];
+	machine->cycleBalance = 0;
+}
+
+//Costs differ by instruction, so this steps one at a time through the
+//handlers rather than handing a count to an interpreter. A wait on
+//FX0A and a halted loop are found the same as by runInstructions, and
+//the rest of the budget only ticks the timers.
+int runCycles( chip8_t* machine, int cycles, runStatus_t* status )
+{
+	//Finish off any instruction the debugger left part way through.
+	while ( machine->subInstruction != 0 )
+		doOneClock( machine );
+
+	const cycleCosts_t* costs = machine->costs;
+	const INSTRUCTION* handlers = machine->profile->handlers;
+	int count = 0;
+	bool halted = false;
+
+	machine->cycleBalance += cycles;
+
+	//One turn of a halted loop is run to check it, every turn after
+	//that fits the budget is only the timers.
+	int length = findHaltLoop( machine );
+
+	if ( length != 0 && machine->cycleBalance > 0 )
+	{
+		int ran = 0;
+		int cost = 0;
+		halted = runHaltTurn( machine, length, &ran, &cost );
+
+		int turns = halted && cost > 0 && machine->cycleBalance > cost ? (machine->cycleBalance - cost) / cost : 0;
+		skipTimers( machine, turns * ran * 3 );
+		ran += turns * ran;
+		cost += turns * cost;
+
+		machine->cycleBalance -= cost;
+		machine->cycles += cost;
+		count += ran;
+	}
+
+	while ( machine->cycleBalance > 0 )
+	{
+		//FX0A repeats until a key is down, spending the rest of the budget.
+		if ( machine->waitingForKey )
+		{
+			int spin = costs->operations[OP_FX0A] ? costs->operations[OP_FX0A] : 1;
+			int skipped = skipKeyWait( machine, (machine->cycleBalance + spin - 1) / spin );
+
+			machine->cycleBalance -= skipped * spin;
+			machine->cycles += skipped * spin;
+			count += skipped;
+
+			if ( skipped )
+				break;
+		}
+
+		instruction_t instruction = decodeInstruction( getOpcode( machine, machine->cpu.pc ) );
+		int cost = instructionCost( costs, instruction );
+
+		advanceTimers( machine, 2 );
+		handlers[instruction.operation]( machine, instruction );
+		advanceTimers( machine, 1 );
+		machine->cpu.pc += 2;
+
+		machine->cycleBalance -= cost;
+		machine->cycles += cost;
+		count++;
+	}
+
+	if ( status )
+		*status = halted ? RUN_HALTED : machine->waitingForKey ? RUN_WAITING : RUN_ACTIVE;
+
+	return count;
+}
+
+//Folds a word into the hash, the multiply and rotate of xxHash64.
+static inline uint64_t mixWord( uint64_t hash, uint64_t word )
+{
+	hash ^= word * 0xC2B2AE3D27D4EB4Full;
+	hash = (hash << 31) | (hash >> 33);
+	return hash * 0x9E3779B185EBCA87ull;
+}
+
+//A word at a time, length has to be a multiple of 8.
+static uint64_t hashBytes( const uint8_t* bytes, size_t length, uint64_t seed )
+{
+	uint64_t hash = seed;
+
+	for ( size_t i = 0; i < length; i += 8 )
+	{
+		uint64_t word;
+		memcpy( &word, bytes + i, sizeof( word ) );
+		hash = mixWord( hash, word );
+	}
+
+	return hash;
+}
+
+uint32_t takeDirtyRows( chip8_t* machine )
+{
+	uint32_t rows = machine->dirtyRows;
+	machine->dirtyRows = 0;
+	return rows;
+}
+
+uint64_t hashMachine( chip8_t* machine )
+{
+	uint16_t dirty = machine->dirtyPages;
+
+	for ( int page = 0; dirty; page++, dirty >>= 1 )
+	{
+		if ( dirty & 1 )
+			machine->pageHashes[page] = hashBytes( machine->pages[page], MEMORY_PAGE_SIZE, page );
+	}
+
+	machine->dirtyPages = 0;
+
+	//With TIMER_FRAME nothing reads the counter, and the interpreters
+	//don't all keep it in step, so it is left out.
+	uint8_t counter = machine->timerClocks == TIMER_FRAME ? 0 : machine->timerCounter;
+
+	uint64_t hash = hashBytes( (const uint8_t*)&machine->cpu, sizeof( cpu_t ), MEMORY_PAGES );
+	hash = mixWord( hash, (uint64_t)machine->random << 32 | (uint64_t)counter << 24
+		| (uint64_t)machine->timerClocks << 16 | (uint64_t)machine->quirks << 8 | (uint64_t)machine->waitingForKey );
+
+	for ( int page = 0; page < MEMORY_PAGES; page++ )
+		hash = mixWord( hash, machine->pageHashes[page] );
+
+	//Final avalanche of MurmurHash3, so every bit of the state reaches
+	//the low bits a hash table indexes by.
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+void seedMachine( chip8_t* machine, uint32_t seed )
+{
+	//Xorshift never leaves 0, so that seed is swapped for another.
+	machine->random = seed ? seed : 0x9E3779B9u;
+}
+
+void setInterpreter( chip8_t* machine, interpreter_t interpreter )
+{
+	uint8_t previous = machine->interpreter;
+	machine->interpreter = interpreter < INTERPRETER_COUNT ? interpreter : INTERPRETER_TABLE;
+
+	//The block cache is only ever built for one interpreter, and
+	//only the table interpreter leaves fused instructions behind.
+	if ( machine->interpreter != previous )
+	{
+		destroyBlockCache( machine );
+
+		for ( int page = 0; page < MEMORY_PAGES; page++ )
+		{
+			if ( machine->decodedPages & (1u << page) )
+				memset( machine->decoded[page], 0x0, sizeof( s_blankDecoded ) );
+		}
+	}
+}
+
+static const char* s_interpreterNames[INTERPRETER_COUNT] = {
+	"table",
+	"threaded",
+	"block",
+	"jit"
+};
+
+void setQuirks( chip8_t* machine, uint8_t quirks )
+{
+	machine->quirks = quirks & QUIRK_ALL;
+	machine->profile = &s_profiles[machine->quirks];
+
+	//Compiled blocks have the old quirks built in.
+	destroyBlockCache( machine );
+}
+
+bool findQuirk( const char* name, uint8_t* quirk )
+{
+	for ( size_t i = 0; i < sizeof( s_quirkNames ) / sizeof( s_quirkNames[0] ); i++ )
+	{
+		if ( strcmp( name, s_quirkNames[i] ) == 0 )
+		{
+			*quirk = 1 << i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char* fusionName( int fusion )
+{
+	return fusion >= 0 && fusion < FUSION_COUNT ? s_fusionNames[fusion] : "unknown";
+}
+
+const char* interpreterName( interpreter_t interpreter )
+{
+	return interpreter < INTERPRETER_COUNT ? s_interpreterNames[interpreter] : "unknown";
+}
+
+bool findInterpreter( const char* name, interpreter_t* interpreter )
+{
+	for ( int i = 0; i < INTERPRETER_COUNT; i++ )
+	{
+		if ( strcmp( name, s_interpreterNames[i] ) == 0 )
+		{
+			*interpreter = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void doOneClock( chip8_t* machine )
+{
+	machine->subInstruction = (machine->subInstruction + 1) % 3;
+	advanceTimers( machine, 1 );
+
+	switch ( machine->subInstruction )
+	{
+	case 0:
+		machine->cpu.pc += 2;
+		break;
+	case 1:
+		machine->opcode = getOpcode( machine, machine->cpu.pc );
+		break;
+	case 2:
+	{
+		instruction_t instruction = decodeInstruction( machine->opcode );
+		machine->profile->handlers[instruction.operation]( machine, instruction );
+	}
+	}
+}
+
+void doOneClockDebug( chip8_t* machine, chip8_t* prevMachine )
+{
+	copyMachine( prevMachine, machine );
+	doOneClock( machine );
+}
+
+void doOneInstructionDebug( chip8_t* machine, chip8_t* prevMachine )
+{
+	copyMachine( prevMachine, machine );
+	runInstructions( machine, 1 );
+}
+
+void destroyMachine( chip8_t* machine )
+{
+	if ( ! machine )
+		return;
+
+	destroyBlockCache( machine );
+	releasePages( machine );
+
+	if ( ! machine->inArena )
+		freeAligned( machine );
+}
+
+struct machineArena_s
+{
+	chip8_t* machines;
+	int count;
+};
+
+machineArena_t* createMachineArena( int count )
+{
+	buildDecodeTable();
+
+	machineArena_t* arena = malloc( sizeof( machineArena_t ) );
+
+	if ( ! arena )
+		return NULL;
+
+	arena->count = count > 0 ? count : 0;
+	arena->machines = allocateAligned( sizeof( chip8_t ) * (arena->count ? arena->count : 1) );
+
+	if ( ! arena->machines )
+	{
+		free( arena );
+		return NULL;
+	}
+
+	//Comes back cleared, so only a few fields are written now. The
+	//rest of each machine isn't touched until it is first run.
+	for ( int i = 0; i < arena->count; i++ )
+	{
+		arena->machines[i].inArena = true;
+		setupMachine( &arena->machines[i] );
+	}
+
+	return arena;
+}
+
+int arenaSize( const machineArena_t* arena )
+{
+	return arena->count;
+}
+
+chip8_t* arenaMachine( machineArena_t* arena, int index )
+{
+	if ( index < 0 || index >= arena->count )
+		return NULL;
+
+	return &arena->machines[index];
+}
+
+void resetMachineArena( machineArena_t* arena )
+{
+	for ( int i = 0; i < arena->count; i++ )
+		resetMachine( &arena->machines[i] );
+}
+
+void destroyMachineArena( machineArena_t* arena )
+{
+	if ( ! arena )
+		return;
+
+	for ( int i = 0; i < arena->count; i++ )
+	{
+		destroyBlockCache( &arena->machines[i] );
+		releasePages( &arena->machines[i] );
+	}
+
+	freeAligned( arena->machines );
+	free( arena );
+}
+
+//Zeroed memory on a cache line boundary. The pointer from calloc is
+//kept just before it for freeAligned. Large blocks come straight from
+//the system already zeroed, so clearing them costs nothing up front.
+static void* allocateAligned( size_t size )
+{
+	uint8_t* block = calloc( 1, size + CACHE_LINE + sizeof( void* ) );
+
+	if ( ! block )
+		return NULL;
+
+	uintptr_t aligned = ((uintptr_t)block + sizeof( void* ) + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1);
+	((void**)aligned)[-1] = block;
+	return (void*)aligned;
+}
+
+static void freeAligned( void* pointer )
+{
+	if ( pointer )
+		free( ((void**)pointer)[-1] );
+}
+
+void executeInstruction( chip8_t* machine, instruction_t instruction )
+{
+	machine->profile->handlers[instruction.operation]( machine, instruction );
+}
+
+//Row of the sprite at ptr with pixel x in bit x, from the cached rows
+//when there are some. Sprites drawn from the framebuffer aren't cached,
+//so their rows are read as they are drawn, each after the rows above.
+static inline uint64_t spriteRow( chip8_t* machine, const uint8_t* rows, int row )
+{
+	if ( rows )
+		return rows[row];
+
+	return reverseBits( loadByte( machine, machine->cpu.ptr + row ) );
+}
+
+//Pixels past the edges wrap around, or with clip set the sprite is
+//placed at the wrapped coordinates and whatever is past the edges is
+//dropped. Each sprite row is turned into a row of the screen and xor'd
+//over it a word at a time.
+void drawSprite( chip8_t* machine, uint8_t x, uint8_t y, uint8_t n, bool clip )
+{
+	registerFlag = 0;
+	uint8_t* video = videoMemory( machine );
+
+	if ( ! video )
+		return;
+
+	const uint8_t* rows = cachedSprite( machine, machine->cpu.ptr, n );
+	x %= 64;
+	y %= 32;
+	uint64_t collided = 0;
+	uint32_t changed = 0;
+
+	//All on screen, nothing to wrap or clip.
+	if ( x <= 56 && y + n <= 32 )
+	{
+		for ( int row = 0; row < n; row++ )
+		{
+			uint64_t sprite = spriteRow( machine, rows, row ) << x;
+			uint64_t pixels = loadRow( video, y + row );
+			collided |= pixels & sprite;
+			changed |= (uint32_t)(sprite != 0) << (y + row);
+			storeRow( video, y + row, pixels ^ sprite );
+		}
+	}
+	else
+	{
+		for ( int row = 0; row < n; row++ )
+		{
+			int line = y + row;
+
+			if ( line >= 32 )
+			{
+				if ( clip )
+					break;
+
+				line -= 32;
+			}
+
+			uint64_t sprite = spriteRow( machine, rows, row );
+
+			if ( clip )
+				sprite <<= x;
+			else
+				sprite = (sprite << x) | (sprite >> ((64 - x) & 63));
+
+			uint64_t pixels = loadRow( video, line );
+			collided |= pixels & sprite;
+			changed |= (uint32_t)(sprite != 0) << line;
+			storeRow( video, line, pixels ^ sprite );
+		}
+	}
+
+	registerFlag = collided != 0;
+	machine->dirtyRows |= changed;
+	invalidateDecoded( machine, VIDEO_MEM_LOCATION, 256 );
+}
+
+//Only the table interpreter gets here, the others decode for themselves.
+void OPDECODE( chip8_t* machine, instruction_t instruction )
+{
+	instruction = fuseInstruction( machine, decodeAndCache( machine, machine->cpu.pc ) );
+	machine->profile->handlers[instruction.operation]( machine, instruction );
+}
+
+//Turns a just decoded instruction into a fused one when it starts one
+//of the sequences, caching the rest of it so runFused can read it.
+//Writes anywhere in the sequence drop the fused instruction.
+instruction_t fuseInstruction( chip8_t* machine, instruction_t instruction )
+{
+	uint16_t pc = machine->cpu.pc;
+
+	//runTable also stands in for the block interpreters when they have
+	//no memory for their cache, and their blocks can't hold fused ones.
+	if ( machine->interpreter != INTERPRETER_TABLE || pc > ADDRESS_MASK + 1 - FUSED_LENGTH * 2 )
+		return instruction;
+
+	operation_t second = decodeInstruction( getOpcode( machine, pc + 2 ) ).operation;
+	operation_t third = decodeInstruction( getOpcode( machine, pc + 4 ) ).operation;
+	operation_t fused;
+
+	if ( instruction.operation == OP_6XNN && second == OP_6XNN && third == OP_DXYN )
+		fused = OP_FUSED_DRAW;
+	else if ( instruction.operation == OP_FX07 && second == OP_3XNN && third == OP_1NNN )
+		fused = OP_FUSED_TIMER_POLL;
+	else if ( instruction.operation == OP_7XNN && second == OP_3XNN && third == OP_1NNN )
+		fused = OP_FUSED_COUNT_LOOP;
+	else
+		return instruction;
+
+	for ( uint16_t address = pc + 2; address < pc + FUSED_LENGTH * 2; address += 2 )
+	{
+		if ( cachedInstruction( machine, address ).operation == OP_DECODE )
+			decodeAndCache( machine, address );
+	}
+
+	//runFused reads the rest from the cache, so all of it has to be there.
+	uint16_t pages = (1u << (pc >> 8)) | (1u << ((pc + (FUSED_LENGTH - 1) * 2) >> 8));
+	if ( (machine->decodedPages & pages) != pages )
+		return instruction;
+
+	instruction.operation = fused;
+	machine->decoded[pc >> 8][(pc & 0xFF) >> 1] = instruction;
+	return instruction;
+}
+
+//Runs a fused sequence up to executing its last instruction, which
+//the caller finishes like any other. Returns how many instructions
+//it ran after the first, a skip can stop it one short.
+int runFused( chip8_t* machine, instruction_t instruction )
+{
+	instruction_t second = cachedInstruction( machine, machine->cpu.pc + 2 );
+	instruction_t third = cachedInstruction( machine, machine->cpu.pc + 4 );
+
+	machine->fusionHits[instruction.operation - OP_FIRST_FUSED]++;
+
+	switch ( instruction.operation )
+	{
+	case OP_FUSED_DRAW:
+		//Nothing here reads the timers, so they catch up in one go.
+		machine->cpu.reg[instruction.x] = instruction.nn;
+		machine->cpu.reg[second.x] = second.nn;
+		skipTimers( machine, 6 );
+		machine->cpu.pc += 4;
+		machine->profile->handlers[OP_DXYN]( machine, third );
+		return 2;
+	case OP_FUSED_TIMER_POLL:
+	case OP_FUSED_COUNT_LOOP:
+		if ( instruction.operation == OP_FUSED_TIMER_POLL )
+			machine->cpu.reg[instruction.x] = machine->cpu.dly;
+		else
+			machine->cpu.reg[instruction.x] += instruction.nn;
+
+		advanceTimers( machine, 3 );
+		machine->cpu.pc += 2;
+
+		if ( machine->cpu.reg[second.x] == second.nn )
+		{
+			machine->cpu.pc += 2;
+			return 1;
+		}
+
+		advanceTimers( machine, 3 );
+		machine->cpu.pc = instructionNNN( third ) - 2;
+		return 2;
+	default:
+		machine->profile->handlers[instruction.operation]( machine, instruction );
+		return 0;
+	}
+}
+
+void OPNOP( chip8_t* machine, instruction_t instruction )
+{
+	(void)machine;
+	(void)instruction;
+}
+
+void OP00E0( chip8_t* machine, instruction_t instruction )
+{
+	(void)instruction;
+
+	//Clear display
+	clearScreen( machine );
+}
+
+void OP00EE( chip8_t* machine, instruction_t instruction )
+{
+	(void)instruction;
+
+	//Return from routine.
+	popReturn( machine );
+}
+
+void OP1NNN( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.pc = getNNN() - 2;
+}
+
+void OP2NNN( chip8_t* machine, instruction_t instruction )
+{
+	pushReturn( machine );
+	machine->cpu.pc = getNNN() - 2;
+}
+
+void OP3XNN( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.pc += (registerX == getNN()) * 2;
+}
+
+void OP4XNN( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.pc += (registerX != getNN()) * 2;
+}
+
+void OP5XY0( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.pc += (registerX == registerY) * 2;
+}
+
+void OP6XNN( chip8_t* machine, instruction_t instruction )
+{
+	registerX = getNN();
+}
+
+void OP7XNN( chip8_t* machine, instruction_t instruction )
+{
+	registerX += getNN();
+}
+
+void OP8XY0( chip8_t* machine, instruction_t instruction )
+{
+	registerX = registerY;
+}
+
+void OP8XY1( chip8_t* machine, instruction_t instruction )
+{
+	registerX |= registerY;
+}
+
+void OP8XY2( chip8_t* machine, instruction_t instruction )
+{
+	registerX &= registerY;
+}
+
+void OP8XY3( chip8_t* machine, instruction_t instruction )
+{
+	registerX ^= registerY;
+}
+
+void OP8XY4( chip8_t* machine, instruction_t instruction )
+{
+	uint16_t sum = registerX + registerY;
+	registerFlag = (sum & 0xFF00u) != 0;
+	registerX = sum;
+}
+
+void OP8XY5( chip8_t* machine, instruction_t instruction )
+{
+	uint16_t sum = registerX - registerY;
+	registerFlag = (sum & 0xFF00u) != 0;
+	registerX = sum;
+}
+
+void OP8XY6( chip8_t* machine, instruction_t instruction )
+{
+	registerFlag = (0x1u & registerX);
+	registerX >>= 1;
+}
+
+void OP8XY7( chip8_t* machine, instruction_t instruction )
+{
+	uint16_t sum = registerY - registerX;
+	registerFlag = (sum & 0xFF00u) != 0;
+	registerX = sum;
+}
+
+void OP8XYE( chip8_t* machine, instruction_t instruction )
+{
+	registerFlag = (0x10000000u & registerX) != 0;
+	registerX <<= 1;
+}
+
+void OP9XY0( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.pc += (registerX != registerY) * 2;
+}
+
+void OPANNN( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.ptr = getNNN();
+}
+
+void OPBNNN( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.pc = getNNN() + machine->cpu.reg[0] - 2;
+}
+
+void OPCXNN( chip8_t* machine, instruction_t instruction )
+{
+	registerX = nextRandom( machine ) & getNN();
+}
+
+void OPDXYN( chip8_t* machine, instruction_t instruction )
+{
+	drawSprite( machine, registerX, registerY, getN(), false );
+}
+
+void OPEX9E( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.pc += (loadByte( machine, KEY_LOCATION + registerX ) == 1) * 2;
+}
+
+void OPEXA1( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.pc += (loadByte( machine, KEY_LOCATION + registerX ) == 0) * 2;
+}
+
+void OPFX07( chip8_t* machine, instruction_t instruction )
+{
+	registerX = machine->cpu.dly;
+}
+
+void OPFX0A( chip8_t* machine, instruction_t instruction )
+{
+	for ( int i = 0; i < NUM_KEYS; i++ )
+	{
+		if ( loadByte( machine, KEY_LOCATION + i ) )
+		{
+			registerX = loadByte( machine, KEY_LOCATION + i );
+			machine->waitingForKey = false;
+			return;
+		}
+	}
+	machine->cpu.pc -= 2; //wait
+	machine->waitingForKey = true;
+}
+
+void OPFX15( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.dly = registerX;
+}
+
+void OPFX18( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.snd = registerX;
+}
+
+void OPFX1E( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.ptr += registerX;
+}
+
+void OPFX29( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.ptr = FONTSET_LOCATION + (5 * registerX);
+}
+
+void OPFX33( chip8_t* machine, instruction_t instruction )
+{
+	storeBCD( machine, registerX );
+}
+
+void OPFX55( chip8_t* machine, instruction_t instruction )
+{
+	storeRegisters( machine, getX() );
+}
+
+void OPFX65( chip8_t* machine, instruction_t instruction )
+{
+	loadRegisters( machine, getX() );
+}
+
+void OP8XY6_VY( chip8_t* machine, instruction_t instruction )
+{
+	uint8_t value = registerY;
+	registerFlag = (0x1u & value);
+	registerX = value >> 1;
+}
+
+void OP8XYE_VY( chip8_t* machine, instruction_t instruction )
+{
+	uint8_t value = registerY;
+	registerFlag = (0x80u & value) != 0;
+	registerX = value << 1;
+}
+
+void OPBXNN( chip8_t* machine, instruction_t instruction )
+{
+	machine->cpu.pc = getNNN() + registerX - 2;
+}
+
+void OPDXYN_CLIP( chip8_t* machine, instruction_t instruction )
+{
+	drawSprite( machine, registerX, registerY, getN(), true );
+}
+
+void OPFX55_PTR( chip8_t* machine, instruction_t instruction )
+{
+	storeRegisters( machine, getX() );
+	machine->cpu.ptr += getX() + 1;
+}
+
+void OPFX65_PTR( chip8_t* machine, instruction_t instruction )
+{
+	loadRegisters( machine, getX() );
+	machine->cpu.ptr += getX() + 1;
+}
+
+//Threaded interpreter, every operation is its own label and each one
+//ends by fetching and jumping straight to the next, so there is no
+//central dispatch or second level switch. Compilers without labels as
+//values (MSVC) get the same bodies in a single switch instead.
+#if defined(__GNUC__) || defined(__clang__)
+#define THREADED_DISPATCH
+#endif
+
+#define VX reg[instruction.x]
+#define VY reg[instruction.y]
+#define VF reg[0xF]
+
+#define FETCH() \
+	advanceTimers( machine, 2 ); \
+	instruction = fetchInstruction( machine, machine->cpu.pc )
+
+#define FINISH() \
+	advanceTimers( machine, 1 ); \
+	machine->cpu.pc += 2
+
+#ifdef THREADED_DISPATCH
+#define OPERATION(op) L_##op:
+#define DISPATCH() goto *s_labels[instruction.operation]
+#define REDISPATCH() DISPATCH()
+#define NEXT() { FINISH(); if ( --remaining <= 0 ) return; FETCH(); DISPATCH(); }
+#define BEGIN_OPERATIONS() if ( remaining <= 0 ) return; FETCH(); DISPATCH(); {
+#define END_OPERATIONS() }
+#else
+#define OPERATION(op) case op:
+#define NEXT() goto next
+#define REDISPATCH() goto redispatch
+#define BEGIN_OPERATIONS() for ( ; remaining > 0; remaining-- ) { FETCH(); redispatch: switch ( instruction.operation ) {
+#define END_OPERATIONS() } next: FINISH(); }
+#endif
+
+#define THREADED_NAME(quirks) THREADED_NAME_( quirks )
+#define THREADED_NAME_(quirks) runThreaded##quirks
+
+#define THREADED_QUIRKS 0
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 1
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 2
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 3
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 4
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 5
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 6
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 7
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 8
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 9
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 10
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 11
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 12
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 13
+#include "Chip8_Threaded.h"
+
+#define THREADED_QUIRKS 14
+#include "Chip8_Threaded.h"
 
+#define THREADED_QUIRKS 15
+#include "Chip8_Threaded.h"
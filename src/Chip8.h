@@ -2,8 +2,10 @@
 #ifndef CHIP8_H
 #define CHIP8_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "Chip8_Decode.h"
 
 typedef struct cpu_s
 {
@@ -15,12 +17,171 @@ typedef struct cpu_s
 	uint16_t ptr;
 } cpu_t;
 
+//Behaviours that differ between CHIP-8 implementations, none set is
+//how c8 has always run. Every combination is its own set of handlers
+//and threaded interpreter, so nothing checks them while running.
+#define QUIRK_SHIFT_VY 0x1      //8XY6 and 8XYE shift VY into VX, rather than VX in place.
+#define QUIRK_INCREMENT_PTR 0x2 //FX55 and FX65 leave ptr after the last register.
+#define QUIRK_CLIP_SPRITES 0x4  //DXYN clips sprites at the screen edges instead of wrapping.
+#define QUIRK_JUMP_VX 0x8       //BXNN jumps to XNN + VX, rather than NNN + V0.
+#define QUIRK_ALL 0xF
+#define QUIRK_PROFILES 16
+
+//Seed of every new machine.
+#define DEFAULT_SEED 1
+
+//Clocks between timer ticks, three clocks to an instruction. c8 has
+//always ticked every 10. At least one instruction has to run between
+//ticks, and the counter has to fit a byte. TIMER_FRAME leaves the
+//ticks to the frontend.
+#define TIMER_CLOCKS 10
+#define MIN_TIMER_CLOCKS 3
+#define MAX_TIMER_CLOCKS 252
+#define TIMER_FRAME 0
+
+typedef enum interpreter_e
+{
+	INTERPRETER_TABLE,    //Function table indexed by the upper nibble.
+	INTERPRETER_THREADED, //Computed goto straight to each operation.
+	INTERPRETER_BLOCK,    //Cached and chained basic blocks.
+	INTERPRETER_JIT,      //Block interpreter with hot blocks compiled to native code.
+	INTERPRETER_COUNT
+} interpreter_t;
+
+//Modeled cost of each instruction, spent by runCycles.
+typedef struct cycleCosts_s
+{
+	const char* name;
+	uint16_t operations[OP_COUNT]; //By operation_t, the fused ones are unused.
+	uint16_t spriteRow;            //Added for each row DXYN draws.
+	uint16_t frame;                //Cycles in a 60 Hz frame, 0 if it has no set speed.
+} cycleCosts_t;
+
+//What the machine was left doing by runInstructions.
+typedef enum runStatus_e
+{
+	RUN_ACTIVE,
+	RUN_WAITING, //On FX0A with no key down.
+	RUN_HALTED,  //In a loop that changes nothing but the timers, forever.
+} runStatus_t;
+
+//Memory is split into pages. Each is either the machine's own or
+//shared, read only, with other machines and copied on its first write.
+#define MEMORY_PAGE_SIZE 0x100
+#define MEMORY_PAGES 16
+#define ALL_PAGES 0xFFFF
+
+//Machines are laid out, and allocated, on cache line boundaries.
+#define CACHE_LINE 64
+#ifdef _MSC_VER
+#define CACHE_ALIGNED __declspec(align(CACHE_LINE))
+#else
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE)))
+#endif
+
+//Entry point of a rom translated to C by --aot. Runs up to count
+//instructions from the pc and returns how many it ran, stopping
+//early at anything it has no code for.
+struct chip8_s;
+typedef int (*compiledRom_t)( struct chip8_s* machine, int count );
+
 typedef struct chip8_s
 {
+	//Execution state, kept per machine so instances don't share
+	//anything and can be stepped on any thread. Everything an
+	//instruction touches besides memory fits this first cache line.
 	cpu_t cpu;
-	uint8_t memory[0x1000];
+
+	//A bit is set for each page with its own decoded entries, so
+	//writes elsewhere don't have to touch the cache.
+	uint16_t decodedPages;
+
+	//A bit is set for each page of memory still shared.
+	uint16_t sharedPages;
+
+	//A bit is set for each page written since hashMachine last hashed it.
+	uint16_t dirtyPages;
+
+	//A bit is set for each page a cached sprite was read from.
+	uint16_t spritePages;
+
+	uint8_t timerCounter;
+	uint8_t timerClocks; //Clocks between timer ticks, see setTimerClocks.
+	uint8_t interpreter;
+
+	//Quirks, and below the handlers for them, see setQuirks.
+	uint8_t quirks;
+
+	//Stopped on FX0A with no key down. Nothing but the timers change
+	//until one is, so a frontend can sleep until it has input.
+	bool waitingForKey;
+
+	//State of the CXNN generator, see seedMachine.
+	uint32_t random;
+
+	const struct profile_s* profile;
+
+	//Basic block cache, created on first use by the block and jit interpreters.
+	struct blockCache_s* blocks;
+
+	//Where each page of memory is, and the instruction decoded at each
+	//even address in it, OP_DECODE until first executed. Pages are
+	//allocated on their own, so the framebuffer never shares a cache
+	//line with the registers. Until a page is written, or has something
+	//decoded, it is shared with other machines.
+	uint8_t* pages[MEMORY_PAGES];
+	instruction_t* decoded[MEMORY_PAGES];
+
+	//A bit is set for each page of memory the machine allocated, and
+	//holds a reference on. Clones share these until one writes to it.
+	uint16_t allocatedPages;
+
+	//Where doOneClock is in the current instruction.
+	uint16_t opcode;
+	uint8_t subInstruction;
+
+	//Runs ahead of the interpreter when set, see setCompiledRom. Only
+	//looked at once a call to runInstructions, and only run while the
+	//machine has the quirks it was compiled for.
+	uint8_t compiledQuirks;
+	compiledRom_t compiled;
+
+	//Sprites already read for DXYN, created on first draw.
+	struct spriteCache_s* sprites;
+
+	//Hash of each page when hashMachine last saw it, see dirtyPages.
+	uint64_t pageHashes[MEMORY_PAGES];
+
+	//Only read by frontends and runCycles, kept off the lines above.
+	//Modeled cycles, see runCycles. The balance is what is left of
+	//the budget so far, below 0 when the last instruction went over.
+	CACHE_ALIGNED const cycleCosts_t* costs;
+	int32_t cycleBalance;
+	uint64_t cycles;
+
+	//Times each fused sequence ran, by operation - OP_FIRST_FUSED.
+	uint64_t fusionHits[FUSION_COUNT];
+
+	//Instructions of idle loops fast forwarded over instead of run.
+	uint64_t idleSkipped;
+
+	//A bit is set for each row of the framebuffer changed since
+	//takeDirtyRows, so frontends only redraw when something did.
+	uint32_t dirtyRows;
+
+	//Part of a machine arena, which owns its memory.
+	bool inArena;
 } chip8_t;
 
+typedef struct blockStats_s
+{
+	uint64_t hits;     //Blocks run that were already translated.
+	uint64_t chained;  //Hits found through a link from the previous block.
+	uint64_t misses;   //Blocks that had to be translated.
+	uint64_t flushes;  //Times the whole cache was dropped.
+	uint64_t compiled; //Blocks compiled to native code by the jit.
+} blockStats_t;
+
 static inline uint16_t getOpcodeRawAddress( uint8_t* memory, uint16_t address )
 {
 	uint16_t lower;
@@ -32,7 +193,11 @@ static inline uint16_t getOpcodeRawAddress( uint8_t* memory, uint16_t address )
 
 static inline uint16_t getOpcode( chip8_t* machine, uint16_t address )
 {
-	return getOpcodeRawAddress( machine->memory, address );
+	uint16_t lower;
+	uint16_t upper;
+	upper = machine->pages[(address >> 8) & 0xF][address & 0xFF];
+	lower = machine->pages[((address + 1) >> 8) & 0xF][(address + 1) & 0xFF];
+	return (upper << 8) | lower;
 }
 
 
@@ -40,12 +205,105 @@ static inline uint16_t getOpcode( chip8_t* machine, uint16_t address )
 #define NUM_KEYS 16
 
 extern chip8_t* createMachine();
+//A new machine in the same state, which shares the machine's memory
+//until either writes to it, so a fork costs the pages it goes on to
+//write. Its caches start empty. copyMachine does the same into a
+//machine that already exists, dropping whatever it had.
+extern chip8_t* cloneMachine( chip8_t* machine );
+extern void copyMachine( chip8_t* target, chip8_t* machine );
+//Puts a machine back how createMachine left it, with the rom and caches gone.
+extern void resetMachine( chip8_t* machine );
+//Bytes the machine has allocated, itself and its caches.
+extern size_t machineFootprint( const chip8_t* machine );
 extern bool peekCall( chip8_t* machine );
+extern runStatus_t runInstructions( chip8_t* machine, int count );
+//runInstructions for each machine in turn, fetching the state of the
+//next ones into cache while one runs, so stepping many more machines
+//than fit in cache doesn't wait on memory for each. Returns how many
+//are still RUN_ACTIVE.
+extern int stepMany( chip8_t** machines, int count, int instructions );
+extern void setInterpreter( chip8_t* machine, interpreter_t interpreter );
+extern const char* interpreterName( interpreter_t interpreter );
+extern bool findInterpreter( const char* name, interpreter_t* interpreter );
+extern bool getBlockStats( chip8_t* machine, blockStats_t* stats );
+extern const char* fusionName( int fusion );
+
+//Picks the handlers for a combination of QUIRK_ bits.
+extern void setQuirks( chip8_t* machine, uint8_t quirks );
+//Quirk bit for a name: shift, memory, clip or jump.
+extern bool findQuirk( const char* name, uint8_t* quirk );
+
+//Sets how many clocks run between ticks of the delay and sound timers.
+//With TIMER_FRAME they only tick on tickTimers, which a frontend calls
+//at 60 Hz so the instructions run per frame don't change game speed.
+extern void setTimerClocks( chip8_t* machine, uint8_t clocks );
+extern void tickTimers( chip8_t* machine );
+
+//Cycle costs by name: uniform, where every instruction is 1, or vip.
+extern const cycleCosts_t* findCycleCosts( const char* name );
+extern void setCycleCosts( chip8_t* machine, const cycleCosts_t* costs );
+
+//Runs instructions until cycles of modeled time have been spent, and
+//returns how many ran. Going over is taken off the next call. Status,
+//if not NULL, is set as runInstructions would return it. This always
+//steps the table handlers one at a time, so the interpreter, compiled
+//rom and idle loop skipping don't apply.
+extern int runCycles( chip8_t* machine, int cycles, runStatus_t* status );
+
+//Rows of the framebuffer changed since the last call, a bit per row
+//with row 0 in bit 0. Drawing, clearing and writes to the memory it
+//is in all count, a new or copied machine starts with every row set.
+extern uint32_t takeDirtyRows( chip8_t* machine );
+
+//Hash of everything that decides what the machine does from here: the
+//cpu, timers, generator and memory. Only pages written since the last
+//call are hashed again, so hashing a clone costs the pages it wrote.
+extern uint64_t hashMachine( chip8_t* machine );
+
+//Seeds the CXNN generator. Each machine has its own, so a run can be
+//replayed from its seed however many machines are running.
+extern void seedMachine( chip8_t* machine, uint32_t seed );
+
+//Runs the rom's compiled code where it can, and the interpreter for
+//whatever it stops at. NULL goes back to only the interpreter. The
+//quirks are built into the code, so it is given the ones it was
+//compiled for, and only the interpreter runs while setQuirks has the
+//machine on any others.
+extern void setCompiledRom( chip8_t* machine, compiledRom_t rom, uint8_t quirks );
+
+//Runs a third of an instruction (advance, fetch or execute),
+//only needed by the debugger to single step clocks.
 extern void doOneClock( chip8_t* machine );
 extern void doOneInstructionDebug( chip8_t* machine, chip8_t* prevMachine );
 extern void doOneClockDebug( chip8_t* machine, chip8_t* prevMachine );
+extern uint8_t readMemory( chip8_t* machine, uint16_t address );
+extern void writeMemory( chip8_t* machine, uint16_t address, uint8_t value );
+//The same as writeMemory for each byte, a page at a time.
+extern void loadMemory( chip8_t* machine, uint16_t address, const uint8_t* data, uint16_t length );
+extern void invalidateDecoded( chip8_t* machine, uint16_t address, uint16_t length );
 extern uint8_t* readCode( const char* filename, int* len );
-extern bool loadRom(uint8_t* memory, const char* filename);
+
+//Loads the file at 0x200 with loadMemory.
+extern bool loadRom( chip8_t* machine, const char* filename );
 extern void destroyMachine(chip8_t* machine);
 
+//Copy of a machine's memory that any number of machines can share,
+//so a rom loaded once runs on all of them. Each gets its own copy of
+//a page the first time it writes to it. The image has to be kept
+//until every machine sharing it is destroyed or reset.
+typedef struct memoryImage_s memoryImage_t;
+extern memoryImage_t* createMemoryImage( const chip8_t* machine );
+extern void shareMemoryImage( chip8_t* machine, const memoryImage_t* image );
+extern void destroyMemoryImage( memoryImage_t* image );
+
+//Many machines in one allocation, each starting as from createMachine,
+//so thousands can be made, reset and dropped at once. The machines
+//belong to the arena, destroyMachine only frees their caches.
+typedef struct machineArena_s machineArena_t;
+extern machineArena_t* createMachineArena( int count );
+extern int arenaSize( const machineArena_t* arena );
+extern chip8_t* arenaMachine( machineArena_t* arena, int index );
+extern void resetMachineArena( machineArena_t* arena );
+extern void destroyMachineArena( machineArena_t* arena );
+
 #endif
\ No newline at end of file
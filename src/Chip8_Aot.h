@@ -0,0 +1,62 @@
+#pragma once
+#ifndef CHIP_8_AOT_H
+#define CHIP_8_AOT_H
+
+//Runtime for roms translated to C by --aot, only included by the
+//generated files. Every instruction starts with BEGIN, which hands
+//back to the interpreter when the count runs out or the code in
+//memory no longer matches what was translated. The timers tick the
+//same as the interpreters so a translated rom behaves identically.
+
+#include <string.h>
+#include "Chip8.h"
+#include "Chip8_Internal.h"
+
+#define V(x) machine->cpu.reg[x]
+
+#define BEGIN(address, opcode) \
+	if ( remaining <= 0 || getOpcode( machine, (address) ) != (opcode) ) \
+	{ \
+		machine->cpu.pc = (address); \
+		return count - remaining; \
+	} \
+	advanceTimers( machine, 2 )
+
+#define END() \
+	advanceTimers( machine, 1 ); \
+	remaining--
+
+//Leave the instruction at address to the interpreter.
+#define EXIT(address) \
+	{ \
+		machine->cpu.pc = (address); \
+		return count - remaining; \
+	}
+
+//Runs an instruction through its handler, which may need the pc.
+#define HANDLER(address, opcode) \
+	machine->cpu.pc = (address); \
+	executeInstruction( machine, decodeInstruction( opcode ) )
+
+//Fast forwards the idle loop at address before going back to it.
+#define SKIP_IDLE(address) \
+	machine->cpu.pc = (address); \
+	remaining -= skipIdleLoop( machine, remaining )
+
+//Same as DISPATCH after FX0A, with the rest of the count spent waiting
+//if it found no key.
+#define WAIT_KEY() \
+	{ \
+		machine->cpu.pc += 2; \
+		remaining -= skipKeyWait( machine, remaining ); \
+		goto dispatch; \
+	}
+
+//Continue from wherever a handler left the pc.
+#define DISPATCH() \
+	{ \
+		machine->cpu.pc += 2; \
+		goto dispatch; \
+	}
+
+#endif
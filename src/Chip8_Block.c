@@ -0,0 +1,328 @@
+#include "Chip8.h"
+#include "Chip8_Internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+//Block interpreter. Straight line runs of instructions, up to and
+//including the first branch (jump, call, return, skip or key wait),
+//are decoded once into a block. Each block remembers the blocks that
+//followed it, so a loop goes block to block without looking anything
+//up. Writing to any byte inside a block drops the whole cache, which
+//only happens for self modifying code.
+//Under the jit interpreter a block that keeps being run without
+//touching the timers is compiled to native code (see Chip8_Jit.c).
+
+#define MAX_BLOCK_LENGTH 32
+#define BLOCK_POOL_SIZE 256
+#define JIT_THRESHOLD 16 //Runs before a block is compiled.
+
+typedef struct block_s
+{
+	struct block_s* links[2];
+	uint16_t start;
+	uint8_t length;
+	uint8_t flags; //operationFlags of every instruction or'd together.
+	uint16_t heat; //Times run, until it is compiled.
+	nativeBlock_t native;
+	instruction_t instructions[MAX_BLOCK_LENGTH];
+} block_t;
+
+typedef struct blockCache_s
+{
+	block_t* entries[0x800];      //By start address / 2.
+	uint8_t coverage[0x1000 / 8]; //Bit per byte of memory inside a block.
+	uint32_t generation;          //Bumped by every flush.
+	int used;
+	blockStats_t stats;
+	struct jit_s* jit; //Only for the jit interpreter, and where there is one.
+	block_t pool[BLOCK_POOL_SIZE];
+} blockCache_t;
+
+static inline bool outsideBlocks( uint16_t pc )
+{
+	return pc & ~ADDRESS_MASK || pc & 1;
+}
+
+static void flushBlocks( blockCache_t* cache )
+{
+	memset( cache->entries, 0, sizeof( cache->entries ) );
+	memset( cache->coverage, 0, sizeof( cache->coverage ) );
+	cache->used = 0;
+	cache->generation++;
+	cache->stats.flushes++;
+
+	if ( cache->jit )
+		resetJit( cache->jit );
+}
+
+static block_t* translateBlock( chip8_t* machine, blockCache_t* cache, uint16_t pc )
+{
+	if ( cache->used == BLOCK_POOL_SIZE )
+		flushBlocks( cache );
+
+	block_t* block = &cache->pool[cache->used++];
+	block->links[0] = NULL;
+	block->links[1] = NULL;
+	block->start = pc;
+	block->length = 0;
+	block->flags = 0;
+	block->heat = 0;
+	block->native = NULL;
+
+	for ( uint16_t address = pc; block->length < MAX_BLOCK_LENGTH && address <= ADDRESS_MASK; address += 2 )
+	{
+		instruction_t instruction = cachedInstruction( machine, address );
+		if ( instruction.operation == OP_DECODE )
+			instruction = decodeAndCache( machine, address );
+
+		block->instructions[block->length++] = instruction;
+		block->flags |= operationFlags[instruction.operation];
+		cache->coverage[address >> 3] |= 0x3 << (address & 0x7);
+
+		if ( operationFlags[instruction.operation] & OPERATION_BRANCH )
+			break;
+	}
+
+	cache->entries[pc >> 1] = block;
+	cache->stats.misses++;
+	return block;
+}
+
+static inline block_t* findBlock( chip8_t* machine, blockCache_t* cache, uint16_t pc )
+{
+	block_t* block = cache->entries[pc >> 1];
+
+	if ( ! block )
+		return translateBlock( machine, cache, pc );
+
+	cache->stats.hits++;
+	return block;
+}
+
+//Runs up to limit instructions from the block with the pc and
+//timers updated for each one, the same as the table interpreter.
+static int runBlockExact( chip8_t* machine, blockCache_t* cache, block_t* block, int limit )
+{
+	uint32_t generation = cache->generation;
+	int count = block->length < limit ? block->length : limit;
+
+	for ( int i = 0; i < count; i++ )
+	{
+		advanceTimers( machine, 2 );
+		machine->cpu.pc = block->start + i * 2;
+		executeInstruction( machine, block->instructions[i] );
+		advanceTimers( machine, 1 );
+		machine->cpu.pc += 2;
+
+		if ( cache->generation != generation )
+			return i + 1;
+	}
+
+	return count;
+}
+
+//Runs the whole block. Nothing in it touches the timers, so they are
+//advanced once at the end, and only the branch at the end needs the pc.
+static int runBlockFast( chip8_t* machine, blockCache_t* cache, block_t* block )
+{
+	uint32_t generation = cache->generation;
+	int last = block->length - 1;
+
+	for ( int i = 0; i < last; i++ )
+	{
+		executeInstruction( machine, block->instructions[i] );
+
+		if ( cache->generation != generation )
+		{
+			machine->cpu.pc = block->start + (i + 1) * 2;
+			skipTimers( machine, (i + 1) * 3 );
+			return i + 1;
+		}
+	}
+
+	machine->cpu.pc = block->start + last * 2;
+	executeInstruction( machine, block->instructions[last] );
+	machine->cpu.pc += 2;
+	skipTimers( machine, block->length * 3 );
+
+	return block->length;
+}
+
+static int runBlockNative( chip8_t* machine, blockCache_t* cache, block_t* block )
+{
+	if ( ! block->native )
+	{
+		if ( ++block->heat < JIT_THRESHOLD )
+			return runBlockFast( machine, cache, block );
+
+		block->native = compileBlock( cache->jit, block->instructions, block->length, block->start, &cache->generation, machine->quirks );
+
+		//Out of space until the next flush, try again later.
+		if ( ! block->native )
+		{
+			block->heat = 0;
+			return runBlockFast( machine, cache, block );
+		}
+
+		cache->stats.compiled++;
+	}
+
+	int executed = block->native( machine );
+	skipTimers( machine, executed * 3 );
+	return executed;
+}
+
+void runBlocks( chip8_t* machine, int count )
+{
+	blockCache_t* cache = machine->blocks;
+
+	if ( ! cache )
+	{
+		cache = calloc( 1, sizeof( blockCache_t ) );
+
+		//No memory for the cache, run this call through the table
+		//interpreter and try again on the next.
+		if ( ! cache )
+		{
+			runTable( machine, count );
+			return;
+		}
+
+		machine->blocks = cache;
+
+		if ( machine->interpreter == INTERPRETER_JIT )
+			cache->jit = createJit();
+	}
+
+	block_t* block = NULL;
+	int remaining = count;
+
+	while ( remaining > 0 )
+	{
+		if ( ! block )
+		{
+			if ( outsideBlocks( machine->cpu.pc ) )
+			{
+				advanceTimers( machine, 2 );
+				executeInstruction( machine, fetchInstruction( machine, machine->cpu.pc ) );
+				advanceTimers( machine, 1 );
+				machine->cpu.pc += 2;
+				remaining--;
+				continue;
+			}
+
+			block = findBlock( machine, cache, machine->cpu.pc );
+		}
+
+		//A block starting on FX07 may be the top of an idle loop, and
+		//one starting on FX0A may be waiting on a key.
+		operation_t first = block->instructions[0].operation;
+
+		if ( first == OP_FX07 || first == OP_FX0A )
+		{
+			int skipped = first == OP_FX07 ? skipIdleLoop( machine, remaining ) : skipKeyWait( machine, remaining );
+
+			if ( skipped )
+			{
+				remaining -= skipped;
+				continue;
+			}
+		}
+
+		uint32_t generation = cache->generation;
+		int executed;
+
+		if ( block->length > remaining || block->flags & OPERATION_TIMER )
+			executed = runBlockExact( machine, cache, block, remaining );
+		else if ( cache->jit )
+			executed = runBlockNative( machine, cache, block );
+		else
+			executed = runBlockFast( machine, cache, block );
+
+		remaining -= executed;
+
+		//Stopped part way through, or the block was flushed under us.
+		if ( executed < block->length || cache->generation != generation || remaining <= 0 )
+		{
+			block = NULL;
+			continue;
+		}
+
+		uint16_t pc = machine->cpu.pc;
+		if ( outsideBlocks( pc ) )
+		{
+			block = NULL;
+			continue;
+		}
+
+		block_t* next;
+		if ( block->links[0] && block->links[0]->start == pc )
+			next = block->links[0];
+		else if ( block->links[1] && block->links[1]->start == pc )
+			next = block->links[1];
+		else
+			next = NULL;
+
+		if ( next )
+		{
+			cache->stats.hits++;
+			cache->stats.chained++;
+		}
+		else
+		{
+			next = findBlock( machine, cache, pc );
+
+			//Translating can flush the pool, which takes this block with it.
+			if ( cache->generation == generation )
+			{
+				if ( ! block->links[0] )
+					block->links[0] = next;
+				else
+					block->links[1] = next;
+			}
+		}
+
+		block = next;
+	}
+}
+
+void invalidateBlocks( chip8_t* machine, uint16_t address, uint16_t length )
+{
+	blockCache_t* cache = machine->blocks;
+
+	for ( uint32_t i = address; i < (uint32_t)address + length; i++ )
+	{
+		uint16_t masked = i & ADDRESS_MASK;
+		if ( cache->coverage[masked >> 3] & (1 << (masked & 0x7)) )
+		{
+			flushBlocks( cache );
+			return;
+		}
+	}
+}
+
+bool getBlockStats( chip8_t* machine, blockStats_t* stats )
+{
+	if ( ! machine->blocks )
+		return false;
+
+	*stats = machine->blocks->stats;
+	return true;
+}
+
+size_t blockCacheFootprint( const chip8_t* machine )
+{
+	if ( ! machine->blocks )
+		return 0;
+
+	return sizeof( blockCache_t ) + jitFootprint( machine->blocks->jit );
+}
+
+void destroyBlockCache( chip8_t* machine )
+{
+	if ( machine->blocks )
+		destroyJit( machine->blocks->jit );
+
+	free( machine->blocks );
+	machine->blocks = NULL;
+}
@@ -0,0 +1,105 @@
+#include "Chip8_Decode.h"
+#include <stdbool.h>
+
+instruction_t decodeTable[0x10000];
+
+static bool s_built = false;
+
+const uint8_t operationFlags[OP_COUNT] = {
+	[OP_DECODE] = OPERATION_BRANCH,
+	[OP_00E0] = OPERATION_WRITE,
+	[OP_00EE] = OPERATION_BRANCH,
+	[OP_1NNN] = OPERATION_BRANCH,
+	[OP_2NNN] = OPERATION_BRANCH | OPERATION_WRITE,
+	[OP_3XNN] = OPERATION_BRANCH,
+	[OP_4XNN] = OPERATION_BRANCH,
+	[OP_5XY0] = OPERATION_BRANCH,
+	[OP_9XY0] = OPERATION_BRANCH,
+	[OP_BNNN] = OPERATION_BRANCH,
+	[OP_DXYN] = OPERATION_WRITE,
+	[OP_EX9E] = OPERATION_BRANCH,
+	[OP_EXA1] = OPERATION_BRANCH,
+	[OP_FX07] = OPERATION_TIMER,
+	[OP_FX0A] = OPERATION_BRANCH,
+	[OP_FX15] = OPERATION_TIMER,
+	[OP_FX18] = OPERATION_TIMER,
+	[OP_FX33] = OPERATION_WRITE,
+	[OP_FX55] = OPERATION_WRITE,
+	[OP_FUSED_TIMER_POLL] = OPERATION_TIMER,
+};
+
+static operation_t decodeOperation( uint16_t opcode )
+{
+	switch ( getOpcodeUpper( opcode ) )
+	{
+	case 0x0:
+		if ( getOpcodeN( opcode ) == 0x0 )
+			return OP_00E0;
+		if ( getOpcodeN( opcode ) == 0xE )
+			return OP_00EE;
+		return OP_NOP;
+	case 0x1: return OP_1NNN;
+	case 0x2: return OP_2NNN;
+	case 0x3: return OP_3XNN;
+	case 0x4: return OP_4XNN;
+	case 0x5: return OP_5XY0;
+	case 0x6: return OP_6XNN;
+	case 0x7: return OP_7XNN;
+	case 0x8:
+		switch ( getOpcodeN( opcode ) )
+		{
+		case 0x0: return OP_8XY0;
+		case 0x1: return OP_8XY1;
+		case 0x2: return OP_8XY2;
+		case 0x3: return OP_8XY3;
+		case 0x4: return OP_8XY4;
+		case 0x5: return OP_8XY5;
+		case 0x6: return OP_8XY6;
+		case 0x7: return OP_8XY7;
+		case 0xE: return OP_8XYE;
+		}
+		return OP_NOP;
+	case 0x9: return OP_9XY0;
+	case 0xA: return OP_ANNN;
+	case 0xB: return OP_BNNN;
+	case 0xC: return OP_CXNN;
+	case 0xD: return OP_DXYN;
+	case 0xE:
+		if ( getOpcodeN( opcode ) == 0xE )
+			return OP_EX9E;
+		if ( getOpcodeN( opcode ) == 0x1 )
+			return OP_EXA1;
+		return OP_NOP;
+	default:
+		switch ( getOpcodeNN( opcode ) )
+		{
+		case 0x07: return OP_FX07;
+		case 0x0A: return OP_FX0A;
+		case 0x15: return OP_FX15;
+		case 0x18: return OP_FX18;
+		case 0x1E: return OP_FX1E;
+		case 0x29: return OP_FX29;
+		case 0x33: return OP_FX33;
+		case 0x55: return OP_FX55;
+		case 0x65: return OP_FX65;
+		}
+		return OP_NOP;
+	}
+}
+
+void buildDecodeTable()
+{
+	if ( s_built )
+		return;
+
+	for ( uint32_t opcode = 0; opcode < 0x10000; opcode++ )
+	{
+		instruction_t* instruction = &decodeTable[opcode];
+		instruction->operation = decodeOperation( opcode );
+		instruction->x = getOpcodeX( opcode );
+		instruction->y = getOpcodeY( opcode );
+		instruction->nn = getOpcodeNN( opcode );
+	}
+
+	s_built = true;
+}
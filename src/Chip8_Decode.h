@@ -0,0 +1,102 @@
+#pragma once
+#ifndef CHIP_8_DECODE_H
+#define CHIP_8_DECODE_H
+
+#include <stdint.h>
+#include "Chip8_Macros.h"
+
+//Every operation the interpreter distinguishes. Opcodes that
+//don't match anything decode to OP_NOP, which does nothing.
+//Matching follows the interpreter, only the nibbles it
+//looks at are checked (any 0xxx0 clears the screen).
+//OP_DECODE is never decoded, it marks an empty entry in a
+//machine's decode cache so that zeroed memory is an empty cache.
+typedef enum operation_e
+{
+	OP_DECODE,
+	OP_NOP,
+	OP_00E0,
+	OP_00EE,
+	OP_1NNN,
+	OP_2NNN,
+	OP_3XNN,
+	OP_4XNN,
+	OP_5XY0,
+	OP_6XNN,
+	OP_7XNN,
+	OP_8XY0,
+	OP_8XY1,
+	OP_8XY2,
+	OP_8XY3,
+	OP_8XY4,
+	OP_8XY5,
+	OP_8XY6,
+	OP_8XY7,
+	OP_8XYE,
+	OP_9XY0,
+	OP_ANNN,
+	OP_BNNN,
+	OP_CXNN,
+	OP_DXYN,
+	OP_EX9E,
+	OP_EXA1,
+	OP_FX07,
+	OP_FX0A,
+	OP_FX15,
+	OP_FX18,
+	OP_FX1E,
+	OP_FX29,
+	OP_FX33,
+	OP_FX55,
+	OP_FX65,
+
+	//Sequences the table interpreter runs as one, made from a cached
+	//instruction and the two after it. Anything else that sees them
+	//only runs the first instruction, whose fields they keep.
+	OP_FUSED_DRAW,       //6XNN 6YNN DXYN, sprite at constant coordinates.
+	OP_FUSED_TIMER_POLL, //FX07 3XNN 1NNN, waiting on the delay timer.
+	OP_FUSED_COUNT_LOOP, //7XNN 3XNN 1NNN, loop on a counter.
+	OP_COUNT
+} operation_t;
+
+#define OP_FIRST_FUSED OP_FUSED_DRAW
+#define FUSION_COUNT (OP_COUNT - OP_FIRST_FUSED)
+#define FUSED_LENGTH 3
+
+//What an operation can do besides change registers.
+enum
+{
+	OPERATION_BRANCH = 0x1, //May leave the pc anywhere other than the next instruction.
+	OPERATION_WRITE = 0x2,  //Writes memory (stack, display or through ptr).
+	OPERATION_TIMER = 0x4   //Reads or writes DLY or SND.
+};
+
+extern const uint8_t operationFlags[OP_COUNT];
+
+//A decoded opcode. N and NNN aren't stored, they are
+//recovered from NN and X with instructionN/instructionNNN.
+typedef struct instruction_s
+{
+	uint8_t operation;
+	uint8_t x;
+	uint8_t y;
+	uint8_t nn;
+} instruction_t;
+
+#define instructionN(instruction) ((instruction).nn & 0x0Fu)
+#define instructionNNN(instruction) ((uint16_t)(((instruction).x << 8) | (instruction).nn))
+
+//Every possible opcode already decoded, filled in by buildDecodeTable.
+extern instruction_t decodeTable[0x10000];
+
+//Fills decodeTable, does nothing after the first call. createMachine
+//calls it, so it only needs calling directly before any threads start
+//when nothing has created a machine yet.
+extern void buildDecodeTable();
+
+static inline instruction_t decodeInstruction( uint16_t opcode )
+{
+	return decodeTable[opcode];
+}
+
+#endif
@@ -0,0 +1,237 @@
+#pragma once
+#ifndef CHIP_8_INTERNAL_H
+#define CHIP_8_INTERNAL_H
+
+//Shared between the interpreters, not part of the public interface.
+
+#include "Chip8.h"
+#include "Chip8_Decode.h"
+
+#define VIDEO_MEM_LOCATION 0xF00
+#define ALL_ROWS 0xFFFFFFFFu
+#define CALL_STACK_LOCATION 0xEA0
+#define CODE_START_LOCATION 0x200
+#define FONTSET_LOCATION 0x50
+#define ADDRESS_MASK 0xFFFu
+
+//Instructions in an idle loop, and the clocks one turn around it takes.
+#define IDLE_LOOP_LENGTH 3
+#define IDLE_LOOP_CLOCKS (IDLE_LOOP_LENGTH * 3)
+
+//Longest loop checked for having halted the machine.
+#define HALT_LOOP_LENGTH 8
+
+//Runs one decoded instruction through the handler table,
+//without touching the pc or timers.
+extern void executeInstruction( chip8_t* machine, instruction_t instruction );
+
+//The table interpreter, also what the block interpreters fall back to.
+extern void runTable( chip8_t* machine, int count );
+extern void runBlocks( chip8_t* machine, int count );
+extern void invalidateBlocks( chip8_t* machine, uint16_t address, uint16_t length );
+extern void destroyBlockCache( chip8_t* machine );
+extern size_t blockCacheFootprint( const chip8_t* machine );
+
+//Rows of the sprite at address, bit reversed so pixel x of a row is
+//bit x, as DXYN draws them. NULL for sprites that can't be cached, in
+//the framebuffer or with no rows, or with no memory for the cache.
+extern const uint8_t* cachedSprite( chip8_t* machine, uint16_t address, uint8_t height );
+extern void invalidateSprites( chip8_t* machine, uint16_t address, uint16_t length );
+extern void destroySpriteCache( chip8_t* machine );
+extern size_t spriteCacheFootprint( const chip8_t* machine );
+
+//Sprites have their leftmost pixel in the top bit, rows in the lowest.
+static inline uint8_t reverseBits( uint8_t byte )
+{
+	return (uint8_t)(((byte * 0x80200802ull) & 0x0884422110ull) * 0x0101010101ull >> 32);
+}
+
+//Native code for a block. Returns how many of its instructions ran and
+//leaves the pc after the last of them, the timers are left to the caller.
+typedef int (*nativeBlock_t)( chip8_t* machine );
+
+//The jit only writes the code, the block cache decides what is worth
+//compiling. createJit returns NULL where there is no jit for the target.
+//Compiled code stops early if the value at generation changes, and
+//is only valid for the quirks it was compiled with.
+extern struct jit_s* createJit();
+extern nativeBlock_t compileBlock( struct jit_s* jit, const instruction_t* instructions, int length, uint16_t start, const uint32_t* generation, uint8_t quirks );
+extern void resetJit( struct jit_s* jit );
+extern void destroyJit( struct jit_s* jit );
+extern size_t jitFootprint( const struct jit_s* jit );
+
+//Ticks the timers every timerClocks clocks. With timerClocks 0 the
+//counter is left to run on, nothing reads it until setTimerClocks.
+static inline void advanceTimers( chip8_t* machine, uint8_t clocks )
+{
+	machine->timerCounter += clocks;
+	if ( machine->timerCounter >= machine->timerClocks && machine->timerClocks != 0 )
+	{
+		machine->timerCounter -= machine->timerClocks;
+		machine->cpu.dly -= machine->cpu.dly != 0;
+		machine->cpu.snd -= machine->cpu.snd != 0;
+	}
+}
+
+//Timer ticks in the next clocks clocks.
+static inline int ticksAfter( chip8_t* machine, int clocks )
+{
+	return machine->timerClocks ? (machine->timerCounter + clocks) / machine->timerClocks : 0;
+}
+
+//Same as advanceTimers over many clocks, for code that
+//doesn't look at the timers in between.
+static inline void skipTimers( chip8_t* machine, int clocks )
+{
+	int ticks = ticksAfter( machine, clocks );
+
+	if ( machine->timerClocks )
+		machine->timerCounter = (machine->timerCounter + clocks) % machine->timerClocks;
+
+	machine->cpu.dly = machine->cpu.dly > ticks ? machine->cpu.dly - ticks : 0;
+	machine->cpu.snd = machine->cpu.snd > ticks ? machine->cpu.snd - ticks : 0;
+}
+
+//The delay timer as it will read after that many more clocks.
+static inline uint8_t delayAfter( chip8_t* machine, int clocks )
+{
+	int ticks = ticksAfter( machine, clocks );
+	return machine->cpu.dly > ticks ? machine->cpu.dly - ticks : 0;
+}
+
+//Fast forwards whole turns of an idle loop starting at the pc, up to
+//count instructions, and returns how many instructions that was.
+extern int skipIdleLoop( chip8_t* machine, int count );
+
+//Fast forwards up to count instructions of waiting on FX0A at the pc
+//while no key is down, and returns how many instructions that was.
+extern int skipKeyWait( chip8_t* machine, int count );
+
+//Xorshift32, returning the high byte as the low bits are the weakest.
+static inline uint8_t nextRandom( chip8_t* machine )
+{
+	uint32_t x = machine->random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	machine->random = x;
+	return x >> 24;
+}
+
+//Reference counts on anything shared between threads.
+#ifdef _MSC_VER
+#include <intrin.h>
+#define atomicIncrement(value) _InterlockedIncrement( (volatile long*)(value) )
+#define atomicDecrement(value) _InterlockedDecrement( (volatile long*)(value) )
+#define atomicLoad(value) _InterlockedOr( (volatile long*)(value), 0 )
+#define atomicLoad64(value) _InterlockedOr64( (volatile long long*)(value), 0 )
+#else
+#define atomicIncrement(value) __atomic_add_fetch( (value), 1, __ATOMIC_ACQ_REL )
+#define atomicDecrement(value) __atomic_sub_fetch( (value), 1, __ATOMIC_ACQ_REL )
+#define atomicLoad(value) __atomic_load_n( (value), __ATOMIC_ACQUIRE )
+#define atomicLoad64(value) __atomic_load_n( (value), __ATOMIC_ACQUIRE )
+#endif
+
+//Hint to start fetching the cache line at address.
+#ifdef _MSC_VER
+#if defined( _M_IX86 ) || defined( _M_X64 )
+#define prefetch(address) _mm_prefetch( (const char*)(address), _MM_HINT_T0 )
+#else
+#define prefetch(address) __prefetch( (const void*)(address) )
+#endif
+#else
+#define prefetch(address) __builtin_prefetch( (address) )
+#endif
+
+//Stores desired if value still holds expected, and returns whether it did.
+static inline bool compareAndSwap64( volatile uint64_t* value, uint64_t expected, uint64_t desired )
+{
+#ifdef _MSC_VER
+	return (uint64_t)_InterlockedCompareExchange64( (volatile long long*)value, (long long)desired, (long long)expected ) == expected;
+#else
+	return __atomic_compare_exchange_n( value, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
+#endif
+}
+
+//Give the machine its own copy of a shared page, or its own page of
+//decoded instructions. Both return false when out of memory, leaving
+//the page shared.
+extern bool ownPage( chip8_t* machine, uint8_t page );
+extern bool ownDecodedPage( chip8_t* machine, uint8_t page );
+
+//Drops the instruction decoded at index, the address / 2.
+static inline void forgetDecoded( chip8_t* machine, uint16_t index )
+{
+	index &= ADDRESS_MASK >> 1;
+
+	if ( machine->decodedPages & (1u << (index >> 7)) )
+		machine->decoded[index >> 7][index & 0x7F].operation = OP_DECODE;
+}
+
+//All writes go through here so a decoded instruction
+//is never left behind for bytes that have changed.
+static inline void storeByte( chip8_t* machine, uint16_t address, uint8_t value )
+{
+	address &= ADDRESS_MASK;
+	uint8_t page = address >> 8;
+
+	//With no memory for a copy the write is lost.
+	if ( machine->sharedPages & (1u << page) && ! ownPage( machine, page ) )
+		return;
+
+	machine->pages[page][address & 0xFF] = value;
+	machine->dirtyPages |= 1u << page;
+
+	if ( page == VIDEO_MEM_LOCATION >> 8 )
+		machine->dirtyRows |= 1u << ((address & 0xFF) >> 3);
+
+	if ( machine->decodedPages & (1u << page) )
+	{
+		//A fused instruction starts up to two instructions back.
+		uint16_t index = address >> 1;
+		forgetDecoded( machine, index );
+		forgetDecoded( machine, index - 1 );
+		forgetDecoded( machine, index - 2 );
+
+		if ( machine->blocks )
+			invalidateBlocks( machine, address, 1 );
+	}
+
+	if ( machine->spritePages & (1u << page) )
+		invalidateSprites( machine, address, 1 );
+}
+
+static inline uint8_t loadByte( chip8_t* machine, uint16_t address )
+{
+	address &= ADDRESS_MASK;
+	return machine->pages[address >> 8][address & 0xFF];
+}
+
+//Cached instruction at an even address inside memory.
+static inline instruction_t cachedInstruction( chip8_t* machine, uint16_t pc )
+{
+	return machine->decoded[pc >> 8][(pc & 0xFF) >> 1];
+}
+
+//Odd and out of range addresses bypass the cache.
+static inline instruction_t fetchInstruction( chip8_t* machine, uint16_t pc )
+{
+	if ( pc & ~ADDRESS_MASK || pc & 1 )
+		return decodeInstruction( getOpcode( machine, pc ) );
+
+	return cachedInstruction( machine, pc );
+}
+
+//Caching is skipped when there is no memory for the page.
+static inline instruction_t decodeAndCache( chip8_t* machine, uint16_t pc )
+{
+	instruction_t instruction = decodeInstruction( getOpcode( machine, pc ) );
+	uint8_t page = pc >> 8;
+
+	if ( machine->decodedPages & (1u << page) || ownDecodedPage( machine, page ) )
+		machine->decoded[page][(pc & 0xFF) >> 1] = instruction;
+
+	return instruction;
+}
+
+#endif
@@ -0,0 +1,438 @@
+#include "Chip8.h"
+#include "Chip8_Internal.h"
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+//x86-64 code for hot blocks. The registers stay in the machine and are
+//used straight from memory through rbx, which holds the machine, and the
+//pc is a constant in the code since every instruction's address is known.
+//Anything that draws, reads keys, uses CXNN or touches the call stack
+//calls back into the handler for it. Other targets get no jit and the
+//jit interpreter runs the same as the block interpreter.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_WIN32)
+#define JIT_X64
+#define JIT_WIN64
+#elif defined(__unix__) || defined(__APPLE__)
+#define JIT_X64
+#endif
+#endif
+
+#ifdef JIT_X64
+
+#ifdef JIT_WIN64
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define JIT_BUFFER_SIZE 0x80000
+
+//Longest any one instruction gets, exit included, plus the prologue.
+#define MAX_INSTRUCTION_BYTES 96
+#define MAX_BLOCK_BYTES (MAX_INSTRUCTION_BYTES * 33)
+
+#define REG_OFFSET(i) ((int32_t)(offsetof( chip8_t, cpu.reg ) + (i)))
+#define PC_OFFSET ((int32_t)offsetof( chip8_t, cpu.pc ))
+#define PTR_OFFSET ((int32_t)offsetof( chip8_t, cpu.ptr ))
+
+//ModRM bytes for [rbx + disp32] with eax, ecx or edx (or an opcode
+//extension) in the reg field.
+#define RBX_DISP32(reg) (0x83 | ((reg) << 3))
+#define EAX 0
+#define ECX 1
+#define EDX 2
+
+typedef struct jit_s
+{
+	uint8_t* code;
+	size_t used;
+} jit_t;
+
+static void emit8( jit_t* jit, uint8_t value );
+static void emit16( jit_t* jit, uint16_t value );
+static void emit32( jit_t* jit, uint32_t value );
+static void emit64( jit_t* jit, uint64_t value );
+static void emitMemory( jit_t* jit, uint8_t opcode, uint8_t reg, int32_t offset );
+static void emitLoadRegister( jit_t* jit, uint8_t reg, uint8_t index );
+static void emitStorePc( jit_t* jit, uint16_t pc );
+static void emitExit( jit_t* jit, uint16_t pc, int count );
+static void emitSkip( jit_t* jit, uint16_t address, uint8_t condition );
+static void emitCall( jit_t* jit, instruction_t instruction );
+static bool emitInstruction( jit_t* jit, instruction_t instruction, uint16_t address, uint8_t quirks );
+static void callInstruction( chip8_t* machine, uint32_t packed );
+
+jit_t* createJit()
+{
+	jit_t* jit = malloc( sizeof( jit_t ) );
+
+	if ( ! jit )
+		return NULL;
+
+#ifdef JIT_WIN64
+	jit->code = VirtualAlloc( NULL, JIT_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
+#else
+	jit->code = mmap( NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if ( jit->code == MAP_FAILED )
+		jit->code = NULL;
+#endif
+
+	if ( ! jit->code )
+	{
+		free( jit );
+		return NULL;
+	}
+
+	jit->used = 0;
+	return jit;
+}
+
+void resetJit( jit_t* jit )
+{
+	jit->used = 0;
+}
+
+void destroyJit( jit_t* jit )
+{
+	if ( ! jit )
+		return;
+
+#ifdef JIT_WIN64
+	VirtualFree( jit->code, 0, MEM_RELEASE );
+#else
+	munmap( jit->code, JIT_BUFFER_SIZE );
+#endif
+	free( jit );
+}
+
+//The whole buffer, reserved up front.
+size_t jitFootprint( const jit_t* jit )
+{
+	return jit ? sizeof( jit_t ) + JIT_BUFFER_SIZE : 0;
+}
+
+//The buffer is only writable while a block is being written,
+//never writable and executable at the same time.
+static bool protectCode( jit_t* jit, bool writable )
+{
+#ifdef JIT_WIN64
+	DWORD old;
+	return VirtualProtect( jit->code, JIT_BUFFER_SIZE, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old );
+#else
+	return mprotect( jit->code, JIT_BUFFER_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC ) == 0;
+#endif
+}
+
+nativeBlock_t compileBlock( jit_t* jit, const instruction_t* instructions, int length, uint16_t start, const uint32_t* generation, uint8_t quirks )
+{
+	if ( JIT_BUFFER_SIZE - jit->used < MAX_BLOCK_BYTES || ! protectCode( jit, true ) )
+		return NULL;
+
+	size_t entry = jit->used;
+
+	//push rbx, then keep the machine in rbx.
+	emit8( jit, 0x53 );
+#ifdef JIT_WIN64
+	//mov rbx, rcx; sub rsp, 32 for the callee's shadow space.
+	emit8( jit, 0x48 ); emit8( jit, 0x89 ); emit8( jit, 0xCB );
+	emit8( jit, 0x48 ); emit8( jit, 0x83 ); emit8( jit, 0xEC ); emit8( jit, 0x20 );
+#else
+	//mov rbx, rdi
+	emit8( jit, 0x48 ); emit8( jit, 0x89 ); emit8( jit, 0xFB );
+#endif
+
+	for ( int i = 0; i < length; i++ )
+	{
+		instruction_t instruction = instructions[i];
+		uint16_t address = start + i * 2;
+		bool last = i == length - 1;
+
+		if ( emitInstruction( jit, instruction, address, quirks ) )
+		{
+			//Handled inline. Branches already left the pc where
+			//the next block starts.
+			if ( last && ! (operationFlags[instruction.operation] & OPERATION_BRANCH) )
+				emitStorePc( jit, address + 2 );
+			continue;
+		}
+
+		emitStorePc( jit, address );
+		emitCall( jit, instruction );
+
+		if ( last )
+		{
+			//add word [rbx + pc], 2
+			emit8( jit, 0x66 );
+			emitMemory( jit, 0x83, 0, PC_OFFSET );
+			emit8( jit, 2 );
+		}
+		else if ( operationFlags[instruction.operation] & OPERATION_WRITE )
+		{
+			//Stop if the write flushed the blocks, this code may be stale.
+			//mov rax, generation; cmp dword [rax], current; je over the exit.
+			emit8( jit, 0x48 ); emit8( jit, 0xB8 ); emit64( jit, (uint64_t)(uintptr_t)generation );
+			emit8( jit, 0x81 ); emit8( jit, 0x38 ); emit32( jit, *generation );
+			emit8( jit, 0x74 );
+			size_t jump = jit->used;
+			emit8( jit, 0 );
+			emitExit( jit, address + 2, i + 1 );
+			jit->code[jump] = (uint8_t)(jit->used - jump - 1);
+		}
+	}
+
+	//mov eax, length
+	emit8( jit, 0xB8 ); emit32( jit, length );
+#ifdef JIT_WIN64
+	emit8( jit, 0x48 ); emit8( jit, 0x83 ); emit8( jit, 0xC4 ); emit8( jit, 0x20 );
+#endif
+	//pop rbx; ret
+	emit8( jit, 0x5B );
+	emit8( jit, 0xC3 );
+
+	if ( ! protectCode( jit, false ) )
+		return NULL;
+
+	return (nativeBlock_t)(void*)(jit->code + entry);
+}
+
+void emit8( jit_t* jit, uint8_t value )
+{
+	jit->code[jit->used++] = value;
+}
+
+void emit16( jit_t* jit, uint16_t value )
+{
+	emit8( jit, value & 0xFF );
+	emit8( jit, value >> 8 );
+}
+
+void emit32( jit_t* jit, uint32_t value )
+{
+	emit16( jit, value & 0xFFFF );
+	emit16( jit, value >> 16 );
+}
+
+void emit64( jit_t* jit, uint64_t value )
+{
+	emit32( jit, value & 0xFFFFFFFF );
+	emit32( jit, value >> 32 );
+}
+
+//opcode followed by ModRM for [rbx + offset].
+void emitMemory( jit_t* jit, uint8_t opcode, uint8_t reg, int32_t offset )
+{
+	emit8( jit, opcode );
+	emit8( jit, RBX_DISP32( reg ) );
+	emit32( jit, offset );
+}
+
+//movzx reg, byte [rbx + V(index)]
+void emitLoadRegister( jit_t* jit, uint8_t reg, uint8_t index )
+{
+	emit8( jit, 0x0F );
+	emitMemory( jit, 0xB6, reg, REG_OFFSET( index ) );
+}
+
+//mov word [rbx + pc], pc
+void emitStorePc( jit_t* jit, uint16_t pc )
+{
+	emit8( jit, 0x66 );
+	emitMemory( jit, 0xC7, 0, PC_OFFSET );
+	emit16( jit, pc );
+}
+
+void emitExit( jit_t* jit, uint16_t pc, int count )
+{
+	emitStorePc( jit, pc );
+	emit8( jit, 0xB8 ); emit32( jit, count );
+#ifdef JIT_WIN64
+	emit8( jit, 0x48 ); emit8( jit, 0x83 ); emit8( jit, 0xC4 ); emit8( jit, 0x20 );
+#endif
+	emit8( jit, 0x5B );
+	emit8( jit, 0xC3 );
+}
+
+//Leaves the pc two or four past address, four when the flags set
+//by the previous compare pass condition (a cmovcc opcode byte).
+void emitSkip( jit_t* jit, uint16_t address, uint8_t condition )
+{
+	//mov eax, address + 2; mov ecx, address + 4 (mov leaves the flags alone).
+	emit8( jit, 0xB8 ); emit32( jit, address + 2 );
+	emit8( jit, 0xB9 ); emit32( jit, address + 4 );
+	//cmovcc eax, ecx
+	emit8( jit, 0x0F ); emit8( jit, condition ); emit8( jit, 0xC1 );
+	//mov [rbx + pc], ax
+	emit8( jit, 0x66 );
+	emitMemory( jit, 0x89, EAX, PC_OFFSET );
+}
+
+void emitCall( jit_t* jit, instruction_t instruction )
+{
+	uint32_t packed;
+	memcpy( &packed, &instruction, sizeof( packed ) );
+
+#ifdef JIT_WIN64
+	//mov rcx, rbx; mov edx, packed
+	emit8( jit, 0x48 ); emit8( jit, 0x89 ); emit8( jit, 0xD9 );
+	emit8( jit, 0xBA ); emit32( jit, packed );
+#else
+	//mov rdi, rbx; mov esi, packed
+	emit8( jit, 0x48 ); emit8( jit, 0x89 ); emit8( jit, 0xDF );
+	emit8( jit, 0xBE ); emit32( jit, packed );
+#endif
+	//mov rax, callInstruction; call rax
+	emit8( jit, 0x48 ); emit8( jit, 0xB8 ); emit64( jit, (uint64_t)(uintptr_t)callInstruction );
+	emit8( jit, 0xFF ); emit8( jit, 0xD0 );
+}
+
+//Writes native code for the instruction, or returns false
+//if it has to go through its handler. Quirks that change an
+//instruction are left to the handler for the machine's profile.
+bool emitInstruction( jit_t* jit, instruction_t instruction, uint16_t address, uint8_t quirks )
+{
+	uint8_t x = instruction.x;
+	uint8_t y = instruction.y;
+
+	switch ( instruction.operation )
+	{
+	case OP_NOP:
+		return true;
+	case OP_1NNN:
+		emitStorePc( jit, instructionNNN( instruction ) );
+		return true;
+	case OP_3XNN:
+	case OP_4XNN:
+		//cmp byte [rbx + VX], NN
+		emitMemory( jit, 0x80, 7, REG_OFFSET( x ) );
+		emit8( jit, instruction.nn );
+		emitSkip( jit, address, instruction.operation == OP_3XNN ? 0x44 : 0x45 );
+		return true;
+	case OP_5XY0:
+	case OP_9XY0:
+		//movzx edx, VX; cmp dl, VY
+		emitLoadRegister( jit, EDX, x );
+		emitMemory( jit, 0x3A, EDX, REG_OFFSET( y ) );
+		emitSkip( jit, address, instruction.operation == OP_5XY0 ? 0x44 : 0x45 );
+		return true;
+	case OP_6XNN:
+		//mov byte [rbx + VX], NN
+		emitMemory( jit, 0xC6, 0, REG_OFFSET( x ) );
+		emit8( jit, instruction.nn );
+		return true;
+	case OP_7XNN:
+		//add byte [rbx + VX], NN
+		emitMemory( jit, 0x80, 0, REG_OFFSET( x ) );
+		emit8( jit, instruction.nn );
+		return true;
+	case OP_8XY0:
+		emitLoadRegister( jit, EAX, y );
+		emitMemory( jit, 0x88, EAX, REG_OFFSET( x ) );
+		return true;
+	case OP_8XY1:
+	case OP_8XY2:
+	case OP_8XY3:
+		//or, and or xor al with VY.
+		emitLoadRegister( jit, EAX, x );
+		emitMemory( jit, instruction.operation == OP_8XY1 ? 0x0A : instruction.operation == OP_8XY2 ? 0x22 : 0x32, EAX, REG_OFFSET( y ) );
+		emitMemory( jit, 0x88, EAX, REG_OFFSET( x ) );
+		return true;
+	case OP_8XY4:
+	case OP_8XY5:
+	case OP_8XY7:
+	{
+		//The carry or borrow goes to VF before the result goes
+		//to VX, same as the handlers, so 8FY4 leaves the sum in VF.
+		uint8_t first = instruction.operation == OP_8XY7 ? y : x;
+		uint8_t second = instruction.operation == OP_8XY7 ? x : y;
+		emitLoadRegister( jit, EAX, first );
+		emitMemory( jit, instruction.operation == OP_8XY4 ? 0x02 : 0x2A, EAX, REG_OFFSET( second ) );
+		//setc byte [rbx + VF]
+		emit8( jit, 0x0F );
+		emitMemory( jit, 0x92, 0, REG_OFFSET( 0xF ) );
+		emitMemory( jit, 0x88, EAX, REG_OFFSET( x ) );
+		return true;
+	}
+	case OP_8XY6:
+		if ( quirks & QUIRK_SHIFT_VY )
+			return false;
+
+		//VF = VX & 1, then VX (which may be VF) >>= 1.
+		emitLoadRegister( jit, EAX, x );
+		emit8( jit, 0x24 ); emit8( jit, 0x01 );
+		emitMemory( jit, 0x88, EAX, REG_OFFSET( 0xF ) );
+		emitLoadRegister( jit, EAX, x );
+		emit8( jit, 0xD0 ); emit8( jit, 0xE8 );
+		emitMemory( jit, 0x88, EAX, REG_OFFSET( x ) );
+		return true;
+	case OP_8XYE:
+		if ( quirks & QUIRK_SHIFT_VY )
+			return false;
+
+		//The handler's flag test never passes, VF is always cleared.
+		emitMemory( jit, 0xC6, 0, REG_OFFSET( 0xF ) );
+		emit8( jit, 0 );
+		emitLoadRegister( jit, EAX, x );
+		emit8( jit, 0xD0 ); emit8( jit, 0xE0 );
+		emitMemory( jit, 0x88, EAX, REG_OFFSET( x ) );
+		return true;
+	case OP_ANNN:
+		//mov word [rbx + ptr], NNN
+		emit8( jit, 0x66 );
+		emitMemory( jit, 0xC7, 0, PTR_OFFSET );
+		emit16( jit, instructionNNN( instruction ) );
+		return true;
+	case OP_FX1E:
+		//add word [rbx + ptr], ax
+		emitLoadRegister( jit, EAX, x );
+		emit8( jit, 0x66 );
+		emitMemory( jit, 0x01, EAX, PTR_OFFSET );
+		return true;
+	case OP_FX29:
+		//lea eax, [rax + rax * 4 + FONTSET_LOCATION]
+		emitLoadRegister( jit, EAX, x );
+		emit8( jit, 0x8D ); emit8( jit, 0x44 ); emit8( jit, 0x80 ); emit8( jit, FONTSET_LOCATION );
+		emit8( jit, 0x66 );
+		emitMemory( jit, 0x89, EAX, PTR_OFFSET );
+		return true;
+	default:
+		return false;
+	}
+}
+
+//Called from native code, the instruction is passed as a plain
+//integer so both calling conventions put it in a register.
+void callInstruction( chip8_t* machine, uint32_t packed )
+{
+	instruction_t instruction;
+	memcpy( &instruction, &packed, sizeof( instruction ) );
+	executeInstruction( machine, instruction );
+}
+
+#else
+
+struct jit_s* createJit()
+{
+	return NULL;
+}
+
+void resetJit( struct jit_s* jit )
+{
+}
+
+void destroyJit( struct jit_s* jit )
+{
+}
+
+size_t jitFootprint( const struct jit_s* jit )
+{
+	return 0;
+}
+
+nativeBlock_t compileBlock( struct jit_s* jit, const instruction_t* instructions, int length, uint16_t start, const uint32_t* generation, uint8_t quirks )
+{
+	return NULL;
+}
+
+#endif
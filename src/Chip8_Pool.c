@@ -0,0 +1,580 @@
+#include "Chip8.h"
+#include "Chip8_Internal.h"
+#include "Chip8_Pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+//Lockstep pool. Machines are split into groups of POOL_LANES with
+//their cpu state stored lane by lane, so register n of every machine
+//in a group is one contiguous array. Each step the group picks the pc
+//most of its machines are at and, if the instruction there only
+//touches registers, runs it for all of those machines at once as
+//plain loops over the lanes that the compiler turns into SIMD
+//instructions. Machines somewhere else, or at an instruction that
+//touches memory, take one instruction through their own interpreter
+//instead and join back in as soon as they reach the same pc.
+//Every machine runs exactly one instruction a step either way, so
+//the pool behaves the same as running each machine on its own.
+//Machines start with the same code, so the code at a shared pc only
+//has to be compared for machines that may have written theirs.
+
+typedef struct poolGroup_s
+{
+	uint8_t reg[16][POOL_LANES];
+	uint8_t snd[POOL_LANES];
+	uint8_t dly[POOL_LANES];
+	uint8_t timerCounter[POOL_LANES];
+	uint16_t sp[POOL_LANES];
+	uint16_t pc[POOL_LANES];
+	uint16_t ptr[POOL_LANES];
+
+	//Memory, decode caches and the scalar path stay per machine.
+	chip8_t* machines[POOL_LANES];
+	int lanes;
+
+	//0xFF for lanes whose code may differ from the rest, see writesCode.
+	uint8_t ownCode[POOL_LANES];
+	int ownCodeLanes;
+} poolGroup_t;
+
+typedef struct pool_s
+{
+	poolGroup_t* groups;
+	machineArena_t* arena; //Every lane's machine, in one allocation.
+	memoryImage_t* image;  //The memory they start with, shared until written.
+	int groupCount;
+	int count;
+	uint8_t quirks;
+	uint8_t timerClocks;
+	poolStats_t stats;
+} pool_t;
+
+static void loadLane( poolGroup_t* group, int lane );
+static void storeLane( poolGroup_t* group, int lane );
+static uint16_t findLeader( const poolGroup_t* group );
+static bool writesCode( const chip8_t* machine, instruction_t instruction );
+static void runScalar( pool_t* pool, poolGroup_t* group, int lane );
+static bool runLockstep( pool_t* pool, poolGroup_t* group, instruction_t instruction, const uint8_t* lanes );
+static void stepGroup( pool_t* pool, poolGroup_t* group );
+
+pool_t* createPool( const chip8_t* machine, int count )
+{
+	pool_t* pool = malloc( sizeof( pool_t ) );
+
+	if ( ! pool )
+		return NULL;
+
+	pool->count = count > 0 ? count : 0;
+	pool->groupCount = (pool->count + POOL_LANES - 1) / POOL_LANES;
+	pool->quirks = machine->quirks;
+	pool->timerClocks = machine->timerClocks;
+	memset( &pool->stats, 0x0, sizeof( pool->stats ) );
+	pool->groups = calloc( pool->groupCount ? pool->groupCount : 1, sizeof( poolGroup_t ) );
+	pool->arena = createMachineArena( pool->count );
+	pool->image = createMemoryImage( machine );
+
+	if ( ! pool->groups || ! pool->arena || ! pool->image )
+	{
+		destroyMemoryImage( pool->image );
+		destroyMachineArena( pool->arena );
+		free( pool->groups );
+		free( pool );
+		return NULL;
+	}
+
+	for ( int i = 0; i < pool->count; i++ )
+	{
+		poolGroup_t* group = &pool->groups[i / POOL_LANES];
+		int lane = i % POOL_LANES;
+		chip8_t* copy = arenaMachine( pool->arena, i );
+
+		shareMemoryImage( copy, pool->image );
+		copy->cpu = machine->cpu;
+		copy->timerCounter = machine->timerCounter;
+		copy->timerClocks = machine->timerClocks;
+		copy->random = machine->random;
+		setInterpreter( copy, machine->interpreter );
+		setQuirks( copy, machine->quirks );
+		setCompiledRom( copy, machine->compiled, machine->compiledQuirks );
+
+		group->machines[lane] = copy;
+		group->lanes = lane + 1;
+		storeLane( group, lane );
+	}
+
+	return pool;
+}
+
+int poolSize( const pool_t* pool )
+{
+	return pool->count;
+}
+
+void runPool( pool_t* pool, int count )
+{
+	//A group at a time, so its state stays in cache.
+	for ( int i = 0; i < pool->groupCount; i++ )
+	{
+		for ( int step = 0; step < count; step++ )
+			stepGroup( pool, &pool->groups[i] );
+	}
+}
+
+void tickPoolTimers( pool_t* pool )
+{
+	for ( int i = 0; i < pool->groupCount; i++ )
+	{
+		poolGroup_t* group = &pool->groups[i];
+
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+		{
+			group->dly[lane] -= group->dly[lane] != 0;
+			group->snd[lane] -= group->snd[lane] != 0;
+		}
+	}
+}
+
+chip8_t* getPoolMachine( pool_t* pool, int index )
+{
+	if ( index < 0 || index >= pool->count )
+		return NULL;
+
+	poolGroup_t* group = &pool->groups[index / POOL_LANES];
+	loadLane( group, index % POOL_LANES );
+	return group->machines[index % POOL_LANES];
+}
+
+void setPoolMachine( pool_t* pool, int index )
+{
+	if ( index < 0 || index >= pool->count )
+		return;
+
+	poolGroup_t* group = &pool->groups[index / POOL_LANES];
+	int lane = index % POOL_LANES;
+	storeLane( group, lane );
+
+	//Its memory may have been changed too.
+	group->ownCodeLanes += ! group->ownCode[lane];
+	group->ownCode[lane] = 0xFF;
+}
+
+void getPoolStats( const pool_t* pool, poolStats_t* stats )
+{
+	*stats = pool->stats;
+}
+
+size_t poolFootprint( const pool_t* pool )
+{
+	size_t bytes = sizeof( pool_t ) + sizeof( poolGroup_t ) * pool->groupCount;
+
+	for ( int i = 0; i < pool->groupCount; i++ )
+	{
+		for ( int lane = 0; lane < pool->groups[i].lanes; lane++ )
+			bytes += machineFootprint( pool->groups[i].machines[lane] );
+	}
+
+	return bytes;
+}
+
+void destroyPool( pool_t* pool )
+{
+	if ( ! pool )
+		return;
+
+	destroyMachineArena( pool->arena );
+	destroyMemoryImage( pool->image );
+	free( pool->groups );
+	free( pool );
+}
+
+//Pool state into the lane's machine.
+void loadLane( poolGroup_t* group, int lane )
+{
+	chip8_t* machine = group->machines[lane];
+
+	for ( int i = 0; i < 16; i++ )
+		machine->cpu.reg[i] = group->reg[i][lane];
+
+	machine->cpu.snd = group->snd[lane];
+	machine->cpu.dly = group->dly[lane];
+	machine->cpu.sp = group->sp[lane];
+	machine->cpu.pc = group->pc[lane];
+	machine->cpu.ptr = group->ptr[lane];
+	machine->timerCounter = group->timerCounter[lane];
+}
+
+//The lane's machine back into the pool.
+void storeLane( poolGroup_t* group, int lane )
+{
+	chip8_t* machine = group->machines[lane];
+
+	for ( int i = 0; i < 16; i++ )
+		group->reg[i][lane] = machine->cpu.reg[i];
+
+	group->snd[lane] = machine->cpu.snd;
+	group->dly[lane] = machine->cpu.dly;
+	group->sp[lane] = machine->cpu.sp;
+	group->pc[lane] = machine->cpu.pc;
+	group->ptr[lane] = machine->cpu.ptr;
+	group->timerCounter[lane] = machine->timerCounter;
+}
+
+//The pc held by most lanes, when more than half agree on one
+//(majority vote), otherwise whichever the vote ends on.
+uint16_t findLeader( const poolGroup_t* group )
+{
+	uint16_t leader = group->pc[0];
+	int votes = 0;
+
+	for ( int lane = 0; lane < group->lanes; lane++ )
+	{
+		if ( votes == 0 )
+			leader = group->pc[lane];
+
+		votes += group->pc[lane] == leader ? 1 : -1;
+	}
+
+	return leader;
+}
+
+//Masks are 0xFF for the lanes taking part and 0 for the rest, so
+//every lane can be worked out and then blended in without branching.
+static inline uint16_t wideMask( uint8_t mask )
+{
+	return (uint16_t)(mask * 0x0101u);
+}
+
+//Same as advanceTimers, for the lanes in mask.
+static inline void advanceLanes( poolGroup_t* group, const uint8_t* mask, uint8_t clocks, uint8_t limit )
+{
+	if ( limit == TIMER_FRAME )
+		return;
+
+	for ( int lane = 0; lane < POOL_LANES; lane++ )
+	{
+		uint8_t counter = group->timerCounter[lane] + (clocks & mask[lane]);
+		uint8_t tick = (counter >= limit) * 0xFF;
+		group->timerCounter[lane] = counter - (limit & tick);
+		group->dly[lane] -= (group->dly[lane] != 0) & tick;
+		group->snd[lane] -= (group->snd[lane] != 0) & tick;
+	}
+}
+
+static inline void storeLanes( uint8_t* destination, const uint8_t* value, const uint8_t* mask )
+{
+	for ( int lane = 0; lane < POOL_LANES; lane++ )
+		destination[lane] = (value[lane] & mask[lane]) | (destination[lane] & ~mask[lane]);
+}
+
+static inline void storeLanes16( uint16_t* destination, const uint16_t* value, const uint8_t* mask )
+{
+	for ( int lane = 0; lane < POOL_LANES; lane++ )
+		destination[lane] = (value[lane] & wideMask( mask[lane] )) | (destination[lane] & ~wideMask( mask[lane] ));
+}
+
+//Runs the instruction for the lanes in mask, or returns false if it
+//touches memory or anything else that is per machine. Results go
+//through a local copy before being blended in, the flag before the
+//result as in the handlers.
+bool runLockstep( pool_t* pool, poolGroup_t* group, instruction_t instruction, const uint8_t* lanes )
+{
+	uint8_t* vx = group->reg[instruction.x];
+	uint8_t* vy = group->reg[instruction.y];
+	uint8_t nn = instruction.nn;
+	uint16_t nnn = instructionNNN( instruction );
+	uint8_t value[POOL_LANES];
+	uint8_t flag[POOL_LANES];
+	uint8_t skip[POOL_LANES]; //0xFF for lanes that skip the next instruction.
+	uint16_t address[POOL_LANES];
+	uint8_t mask[POOL_LANES];
+
+	switch ( instruction.operation )
+	{
+	case OP_NOP:
+	case OP_1NNN:
+	case OP_3XNN:
+	case OP_4XNN:
+	case OP_5XY0:
+	case OP_6XNN:
+	case OP_7XNN:
+	case OP_8XY0:
+	case OP_8XY1:
+	case OP_8XY2:
+	case OP_8XY3:
+	case OP_8XY4:
+	case OP_8XY5:
+	case OP_8XY6:
+	case OP_8XY7:
+	case OP_8XYE:
+	case OP_9XY0:
+	case OP_ANNN:
+	case OP_BNNN:
+	case OP_FX07:
+	case OP_FX15:
+	case OP_FX18:
+	case OP_FX1E:
+	case OP_FX29:
+		break;
+	default:
+		return false;
+	}
+
+	//A local copy can't alias the group, so the loops need no checks.
+	memcpy( mask, lanes, sizeof( mask ) );
+	advanceLanes( group, mask, 2, pool->timerClocks );
+	memset( skip, 0x0, sizeof( skip ) );
+
+	switch ( instruction.operation )
+	{
+	case OP_1NNN:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			address[lane] = nnn - 2;
+		storeLanes16( group->pc, address, mask );
+		break;
+	case OP_3XNN:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			skip[lane] = (vx[lane] == nn) * 0xFF;
+		break;
+	case OP_4XNN:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			skip[lane] = (vx[lane] != nn) * 0xFF;
+		break;
+	case OP_5XY0:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			skip[lane] = (vx[lane] == vy[lane]) * 0xFF;
+		break;
+	case OP_9XY0:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			skip[lane] = (vx[lane] != vy[lane]) * 0xFF;
+		break;
+	case OP_6XNN:
+		memset( value, nn, sizeof( value ) );
+		storeLanes( vx, value, mask );
+		break;
+	case OP_7XNN:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			value[lane] = vx[lane] + nn;
+		storeLanes( vx, value, mask );
+		break;
+	case OP_8XY0:
+		memcpy( value, vy, sizeof( value ) );
+		storeLanes( vx, value, mask );
+		break;
+	case OP_8XY1:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			value[lane] = vx[lane] | vy[lane];
+		storeLanes( vx, value, mask );
+		break;
+	case OP_8XY2:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			value[lane] = vx[lane] & vy[lane];
+		storeLanes( vx, value, mask );
+		break;
+	case OP_8XY3:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			value[lane] = vx[lane] ^ vy[lane];
+		storeLanes( vx, value, mask );
+		break;
+	case OP_8XY4:
+		//Carry out of the 8 bit sum.
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+		{
+			value[lane] = vx[lane] + vy[lane];
+			flag[lane] = value[lane] < vx[lane];
+		}
+		storeLanes( group->reg[0xF], flag, mask );
+		storeLanes( vx, value, mask );
+		break;
+	case OP_8XY5:
+		//Borrow out of the 8 bit difference.
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+		{
+			value[lane] = vx[lane] - vy[lane];
+			flag[lane] = vx[lane] < vy[lane];
+		}
+		storeLanes( group->reg[0xF], flag, mask );
+		storeLanes( vx, value, mask );
+		break;
+	case OP_8XY7:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+		{
+			value[lane] = vy[lane] - vx[lane];
+			flag[lane] = vy[lane] < vx[lane];
+		}
+		storeLanes( group->reg[0xF], flag, mask );
+		storeLanes( vx, value, mask );
+		break;
+	case OP_8XY6:
+	case OP_8XYE:
+		//The quirk shifts VY as it was before the flag is set, without
+		//it VX is shifted after, which differs when X is F. Without the
+		//quirk the handler's flag test for 8XYE never passes.
+		memcpy( value, pool->quirks & QUIRK_SHIFT_VY ? vy : vx, sizeof( value ) );
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			flag[lane] = instruction.operation == OP_8XY6 ? value[lane] & 0x1u : value[lane] >> 7;
+		if ( instruction.operation == OP_8XYE && ! (pool->quirks & QUIRK_SHIFT_VY) )
+			memset( flag, 0x0, sizeof( flag ) );
+		storeLanes( group->reg[0xF], flag, mask );
+
+		if ( ! (pool->quirks & QUIRK_SHIFT_VY) )
+			memcpy( value, vx, sizeof( value ) );
+
+		if ( instruction.operation == OP_8XY6 )
+		{
+			for ( int lane = 0; lane < POOL_LANES; lane++ )
+				value[lane] >>= 1;
+		}
+		else
+		{
+			for ( int lane = 0; lane < POOL_LANES; lane++ )
+				value[lane] <<= 1;
+		}
+		storeLanes( vx, value, mask );
+		break;
+	case OP_ANNN:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			address[lane] = nnn;
+		storeLanes16( group->ptr, address, mask );
+		break;
+	case OP_BNNN:
+	{
+		const uint8_t* offset = group->reg[pool->quirks & QUIRK_JUMP_VX ? instruction.x : 0];
+
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			address[lane] = nnn + offset[lane] - 2;
+		storeLanes16( group->pc, address, mask );
+		break;
+	}
+	case OP_FX07:
+		memcpy( value, group->dly, sizeof( value ) );
+		storeLanes( vx, value, mask );
+		break;
+	case OP_FX15:
+		memcpy( value, vx, sizeof( value ) );
+		storeLanes( group->dly, value, mask );
+		break;
+	case OP_FX18:
+		memcpy( value, vx, sizeof( value ) );
+		storeLanes( group->snd, value, mask );
+		break;
+	case OP_FX1E:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			address[lane] = group->ptr[lane] + vx[lane];
+		storeLanes16( group->ptr, address, mask );
+		break;
+	case OP_FX29:
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+			address[lane] = FONTSET_LOCATION + 5 * vx[lane];
+		storeLanes16( group->ptr, address, mask );
+		break;
+	default:
+		break;
+	}
+
+	advanceLanes( group, mask, 1, pool->timerClocks );
+
+	for ( int lane = 0; lane < POOL_LANES; lane++ )
+		group->pc[lane] += (2 + (skip[lane] & 2)) & mask[lane];
+
+	return true;
+}
+
+//Whether the instruction, just run, may have written code. The screen
+//and the call stack are never compared as code, see stepGroup.
+bool writesCode( const chip8_t* machine, instruction_t instruction )
+{
+	switch ( instruction.operation )
+	{
+	case OP_00E0:
+	case OP_DXYN:
+		return false;
+	case OP_2NNN:
+		return (machine->cpu.sp & ADDRESS_MASK) < CALL_STACK_LOCATION || ((machine->cpu.sp + 1) & ADDRESS_MASK) < CALL_STACK_LOCATION;
+	default:
+		return (operationFlags[instruction.operation] & OPERATION_WRITE) != 0;
+	}
+}
+
+//Runs an instruction on the lane's own machine.
+void runScalar( pool_t* pool, poolGroup_t* group, int lane )
+{
+	chip8_t* machine = group->machines[lane];
+	instruction_t instruction = decodeInstruction( getOpcode( machine, group->pc[lane] ) );
+
+	loadLane( group, lane );
+	runInstructions( machine, 1 );
+	storeLane( group, lane );
+	pool->stats.scalar++;
+
+	if ( ! group->ownCode[lane] && writesCode( machine, instruction ) )
+	{
+		group->ownCode[lane] = 0xFF;
+		group->ownCodeLanes++;
+	}
+}
+
+void stepGroup( pool_t* pool, poolGroup_t* group )
+{
+	uint16_t pc = group->pc[0];
+	uint8_t mask[POOL_LANES];
+	int together = 0;
+	int leader = 0;
+
+	for ( int lane = 0; lane < POOL_LANES; lane++ )
+	{
+		mask[lane] = (lane < group->lanes && group->pc[lane] == pc) * 0xFF;
+		together += mask[lane] & 1;
+	}
+
+	if ( together != group->lanes )
+	{
+		pc = findLeader( group );
+		together = 0;
+
+		for ( int lane = 0; lane < POOL_LANES; lane++ )
+		{
+			mask[lane] = (lane < group->lanes && group->pc[lane] == pc) * 0xFF;
+			together += mask[lane] & 1;
+		}
+
+		while ( ! mask[leader] )
+			leader++;
+	}
+
+	//Lanes at the same pc can still hold different code if they have
+	//written it, or the pc is past the code into the stack or screen.
+	uint16_t opcode = getOpcode( group->machines[leader], pc );
+	bool pastCode = (pc & ADDRESS_MASK) >= CALL_STACK_LOCATION || ((pc + 1) & ADDRESS_MASK) >= CALL_STACK_LOCATION;
+	uint8_t compareAll = group->ownCode[leader] | (pastCode ? 0xFF : 0);
+
+	if ( group->ownCodeLanes || compareAll )
+	{
+		for ( int lane = leader + 1; lane < group->lanes; lane++ )
+		{
+			if ( mask[lane] & (group->ownCode[lane] | compareAll) && getOpcode( group->machines[lane], pc ) != opcode )
+			{
+				mask[lane] = 0;
+				together--;
+			}
+		}
+	}
+
+	if ( together > 1 && runLockstep( pool, group, decodeInstruction( opcode ), mask ) )
+	{
+		pool->stats.lockstep += together;
+
+		if ( together == group->lanes )
+			return;
+	}
+	else
+	{
+		memset( mask, 0x0, sizeof( mask ) );
+	}
+
+	//Everything that didn't run goes one at a time.
+	for ( int lane = 0; lane < group->lanes; lane++ )
+	{
+		if ( ! mask[lane] )
+			runScalar( pool, group, lane );
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#ifndef CHIP_8_POOL_H
+#define CHIP_8_POOL_H
+
+#include "Chip8.h"
+
+//Many copies of one machine stepped together. See Chip8_Pool.c.
+
+//Machines run together by one pass of the vector path. 32 fills an
+//AVX2 register with the 8 bit registers, 16 an SSE or NEON one.
+#ifndef POOL_LANES
+#define POOL_LANES 32
+#endif
+
+typedef struct pool_s pool_t;
+
+typedef struct poolStats_s
+{
+	uint64_t lockstep; //Instructions run by the vector path, counted per machine.
+	uint64_t scalar;   //Instructions run one machine at a time.
+} poolStats_t;
+
+//Makes count copies of machine, with its memory, registers, random
+//state, quirks, interpreter and compiled rom. The copies share one
+//image of its memory until they write to it. The machine itself isn't used after.
+extern pool_t* createPool( const chip8_t* machine, int count );
+extern int poolSize( const pool_t* pool );
+
+//Runs count instructions on every machine in the pool.
+extern void runPool( pool_t* pool, int count );
+//tickTimers for every machine, for pools made with TIMER_FRAME.
+extern void tickPoolTimers( pool_t* pool );
+
+//The machine at index with its registers brought up to date. The
+//keys can be changed directly, changes to its cpu or any other
+//memory only take effect after setPoolMachine.
+extern chip8_t* getPoolMachine( pool_t* pool, int index );
+extern void setPoolMachine( pool_t* pool, int index );
+
+extern void getPoolStats( const pool_t* pool, poolStats_t* stats );
+//Bytes allocated by the pool and every machine in it.
+extern size_t poolFootprint( const pool_t* pool );
+extern void destroyPool( pool_t* pool );
+
+#endif
@@ -0,0 +1,107 @@
+#include "Chip8.h"
+#include "Chip8_Internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+//Sprite cache. Games draw the same sprites from the same addresses
+//every frame, so DXYN keeps the rows of each one it draws already bit
+//reversed into screen order, leaving one shift and one xor a row.
+//Entries are direct mapped by address and height. Writing to any byte
+//of a cached sprite drops the whole cache, the same as the block
+//cache, which only happens for roms that build their sprites in memory.
+//Sprites in the framebuffer page change under every draw, so they are
+//never cached.
+
+#define SPRITE_CACHE_SIZE 64 //Entries, a power of two.
+#define MAX_SPRITE_HEIGHT 15
+
+typedef struct sprite_s
+{
+	uint16_t address;
+	uint8_t height; //0 for an empty entry.
+	uint8_t rows[MAX_SPRITE_HEIGHT];
+} sprite_t;
+
+typedef struct spriteCache_s
+{
+	sprite_t entries[SPRITE_CACHE_SIZE];
+	uint8_t coverage[0x1000 / 8]; //Bit per byte of memory inside a cached sprite.
+} spriteCache_t;
+
+static inline int spriteIndex( uint16_t address, uint8_t height )
+{
+	return (address ^ (address >> 6) ^ (height << 3)) & (SPRITE_CACHE_SIZE - 1);
+}
+
+const uint8_t* cachedSprite( chip8_t* machine, uint16_t address, uint8_t height )
+{
+	address &= ADDRESS_MASK;
+
+	if ( height == 0 || address + height > VIDEO_MEM_LOCATION )
+		return NULL;
+
+	spriteCache_t* cache = machine->sprites;
+
+	if ( ! cache )
+	{
+		cache = calloc( 1, sizeof( spriteCache_t ) );
+
+		if ( ! cache )
+			return NULL;
+
+		machine->sprites = cache;
+	}
+
+	sprite_t* sprite = &cache->entries[spriteIndex( address, height )];
+
+	if ( sprite->address == address && sprite->height == height )
+		return sprite->rows;
+
+	sprite->address = address;
+	sprite->height = height;
+
+	for ( int row = 0; row < height; row++ )
+	{
+		uint16_t byte = address + row;
+		sprite->rows[row] = reverseBits( loadByte( machine, byte ) );
+		cache->coverage[byte >> 3] |= 1 << (byte & 0x7);
+		machine->spritePages |= 1u << (byte >> 8);
+	}
+
+	return sprite->rows;
+}
+
+void invalidateSprites( chip8_t* machine, uint16_t address, uint16_t length )
+{
+	spriteCache_t* cache = machine->sprites;
+
+	for ( uint32_t i = address; i < (uint32_t)address + length; i++ )
+	{
+		uint16_t masked = i & ADDRESS_MASK;
+		if ( ! (machine->spritePages & (1u << (masked >> 8))) )
+		{
+			//Nothing cached from this page, skip to the next one.
+			i |= 0xFF;
+			continue;
+		}
+
+		if ( cache->coverage[masked >> 3] & (1 << (masked & 0x7)) )
+		{
+			memset( cache, 0x0, sizeof( spriteCache_t ) );
+			machine->spritePages = 0;
+			return;
+		}
+	}
+}
+
+size_t spriteCacheFootprint( const chip8_t* machine )
+{
+	return machine->sprites ? sizeof( spriteCache_t ) : 0;
+}
+
+void destroySpriteCache( chip8_t* machine )
+{
+	free( machine->sprites );
+	machine->sprites = NULL;
+	machine->spritePages = 0;
+}
@@ -0,0 +1,260 @@
+//Body of the threaded interpreter, included by Chip8.c once for every
+//quirk profile with THREADED_QUIRKS defined, so each profile gets its
+//own copy with the quirks decided by the preprocessor.
+
+static void THREADED_NAME( THREADED_QUIRKS )( chip8_t* machine, int count )
+{
+#ifdef THREADED_DISPATCH
+	static const void* s_labels[OP_COUNT] = {
+		[OP_DECODE] = &&L_OP_DECODE,
+		[OP_NOP] = &&L_OP_NOP,
+		[OP_00E0] = &&L_OP_00E0,
+		[OP_00EE] = &&L_OP_00EE,
+		[OP_1NNN] = &&L_OP_1NNN,
+		[OP_2NNN] = &&L_OP_2NNN,
+		[OP_3XNN] = &&L_OP_3XNN,
+		[OP_4XNN] = &&L_OP_4XNN,
+		[OP_5XY0] = &&L_OP_5XY0,
+		[OP_6XNN] = &&L_OP_6XNN,
+		[OP_7XNN] = &&L_OP_7XNN,
+		[OP_8XY0] = &&L_OP_8XY0,
+		[OP_8XY1] = &&L_OP_8XY1,
+		[OP_8XY2] = &&L_OP_8XY2,
+		[OP_8XY3] = &&L_OP_8XY3,
+		[OP_8XY4] = &&L_OP_8XY4,
+		[OP_8XY5] = &&L_OP_8XY5,
+		[OP_8XY6] = &&L_OP_8XY6,
+		[OP_8XY7] = &&L_OP_8XY7,
+		[OP_8XYE] = &&L_OP_8XYE,
+		[OP_9XY0] = &&L_OP_9XY0,
+		[OP_ANNN] = &&L_OP_ANNN,
+		[OP_BNNN] = &&L_OP_BNNN,
+		[OP_CXNN] = &&L_OP_CXNN,
+		[OP_DXYN] = &&L_OP_DXYN,
+		[OP_EX9E] = &&L_OP_EX9E,
+		[OP_EXA1] = &&L_OP_EXA1,
+		[OP_FX07] = &&L_OP_FX07,
+		[OP_FX0A] = &&L_OP_FX0A,
+		[OP_FX15] = &&L_OP_FX15,
+		[OP_FX18] = &&L_OP_FX18,
+		[OP_FX1E] = &&L_OP_FX1E,
+		[OP_FX29] = &&L_OP_FX29,
+		[OP_FX33] = &&L_OP_FX33,
+		[OP_FX55] = &&L_OP_FX55,
+		[OP_FX65] = &&L_OP_FX65,
+	};
+#endif
+
+	uint8_t* reg = machine->cpu.reg;
+	instruction_t instruction;
+	uint16_t sum;
+	int remaining = count;
+
+	BEGIN_OPERATIONS()
+
+	OPERATION( OP_DECODE )
+		instruction = decodeAndCache( machine, machine->cpu.pc );
+		REDISPATCH();
+
+	OPERATION( OP_NOP )
+		NEXT();
+
+	OPERATION( OP_00E0 )
+		clearScreen( machine );
+		NEXT();
+
+	OPERATION( OP_00EE )
+		popReturn( machine );
+		NEXT();
+
+	OPERATION( OP_1NNN )
+		//Jumping back to the start of an idle loop is the one place to
+		//look for it, the rest of the loop is then skipped over.
+		machine->cpu.pc = instructionNNN( instruction ) - 2;
+		FINISH();
+		if ( --remaining <= 0 )
+			return;
+		remaining -= skipIdleLoop( machine, remaining );
+		if ( remaining <= 0 )
+			return;
+		FETCH();
+		REDISPATCH();
+
+	OPERATION( OP_2NNN )
+		pushReturn( machine );
+		machine->cpu.pc = instructionNNN( instruction ) - 2;
+		NEXT();
+
+	OPERATION( OP_3XNN )
+		machine->cpu.pc += (VX == instruction.nn) * 2;
+		NEXT();
+
+	OPERATION( OP_4XNN )
+		machine->cpu.pc += (VX != instruction.nn) * 2;
+		NEXT();
+
+	OPERATION( OP_5XY0 )
+		machine->cpu.pc += (VX == VY) * 2;
+		NEXT();
+
+	OPERATION( OP_6XNN )
+		VX = instruction.nn;
+		NEXT();
+
+	OPERATION( OP_7XNN )
+		VX += instruction.nn;
+		NEXT();
+
+	OPERATION( OP_8XY0 )
+		VX = VY;
+		NEXT();
+
+	OPERATION( OP_8XY1 )
+		VX |= VY;
+		NEXT();
+
+	OPERATION( OP_8XY2 )
+		VX &= VY;
+		NEXT();
+
+	OPERATION( OP_8XY3 )
+		VX ^= VY;
+		NEXT();
+
+	OPERATION( OP_8XY4 )
+		sum = VX + VY;
+		VF = (sum & 0xFF00u) != 0;
+		VX = sum;
+		NEXT();
+
+	OPERATION( OP_8XY5 )
+		sum = VX - VY;
+		VF = (sum & 0xFF00u) != 0;
+		VX = sum;
+		NEXT();
+
+	OPERATION( OP_8XY6 )
+#if THREADED_QUIRKS & QUIRK_SHIFT_VY
+		sum = VY;
+		VF = (0x1u & sum);
+		VX = sum >> 1;
+#else
+		VF = (0x1u & VX);
+		VX >>= 1;
+#endif
+		NEXT();
+
+	OPERATION( OP_8XY7 )
+		sum = VY - VX;
+		VF = (sum & 0xFF00u) != 0;
+		VX = sum;
+		NEXT();
+
+	OPERATION( OP_8XYE )
+#if THREADED_QUIRKS & QUIRK_SHIFT_VY
+		sum = VY;
+		VF = (0x80u & sum) != 0;
+		VX = sum << 1;
+#else
+		VF = (0x10000000u & VX) != 0;
+		VX <<= 1;
+#endif
+		NEXT();
+
+	OPERATION( OP_9XY0 )
+		machine->cpu.pc += (VX != VY) * 2;
+		NEXT();
+
+	OPERATION( OP_ANNN )
+		machine->cpu.ptr = instructionNNN( instruction );
+		NEXT();
+
+	OPERATION( OP_BNNN )
+#if THREADED_QUIRKS & QUIRK_JUMP_VX
+		machine->cpu.pc = instructionNNN( instruction ) + VX - 2;
+#else
+		machine->cpu.pc = instructionNNN( instruction ) + reg[0] - 2;
+#endif
+		NEXT();
+
+	OPERATION( OP_CXNN )
+		VX = nextRandom( machine ) & instruction.nn;
+		NEXT();
+
+	OPERATION( OP_DXYN )
+		drawSprite( machine, VX, VY, instructionN( instruction ), THREADED_QUIRKS & QUIRK_CLIP_SPRITES );
+		NEXT();
+
+	OPERATION( OP_EX9E )
+		machine->cpu.pc += (loadByte( machine, KEY_LOCATION + VX ) == 1) * 2;
+		NEXT();
+
+	OPERATION( OP_EXA1 )
+		machine->cpu.pc += (loadByte( machine, KEY_LOCATION + VX ) == 0) * 2;
+		NEXT();
+
+	OPERATION( OP_FX07 )
+		VX = machine->cpu.dly;
+		NEXT();
+
+	OPERATION( OP_FX0A )
+		for ( int i = 0; i < NUM_KEYS; i++ )
+		{
+			if ( loadByte( machine, KEY_LOCATION + i ) )
+			{
+				VX = loadByte( machine, KEY_LOCATION + i );
+				machine->waitingForKey = false;
+				NEXT();
+			}
+		}
+		//Nothing changes the keys until the call returns, so the rest
+		//of it is spent waiting.
+		machine->cpu.pc -= 2;
+		machine->waitingForKey = true;
+		FINISH();
+		if ( --remaining <= 0 )
+			return;
+		remaining -= skipKeyWait( machine, remaining );
+		if ( remaining <= 0 )
+			return;
+		FETCH();
+		REDISPATCH();
+
+	OPERATION( OP_FX15 )
+		machine->cpu.dly = VX;
+		NEXT();
+
+	OPERATION( OP_FX18 )
+		machine->cpu.snd = VX;
+		NEXT();
+
+	OPERATION( OP_FX1E )
+		machine->cpu.ptr += VX;
+		NEXT();
+
+	OPERATION( OP_FX29 )
+		machine->cpu.ptr = FONTSET_LOCATION + (5 * VX);
+		NEXT();
+
+	OPERATION( OP_FX33 )
+		storeBCD( machine, VX );
+		NEXT();
+
+	OPERATION( OP_FX55 )
+		storeRegisters( machine, instruction.x );
+#if THREADED_QUIRKS & QUIRK_INCREMENT_PTR
+		machine->cpu.ptr += instruction.x + 1;
+#endif
+		NEXT();
+
+	OPERATION( OP_FX65 )
+		loadRegisters( machine, instruction.x );
+#if THREADED_QUIRKS & QUIRK_INCREMENT_PTR
+		machine->cpu.ptr += instruction.x + 1;
+#endif
+		NEXT();
+
+	END_OPERATIONS()
+}
+
+#undef THREADED_QUIRKS
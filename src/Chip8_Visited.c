@@ -0,0 +1,86 @@
+#include "Chip8.h"
+#include "Chip8_Internal.h"
+#include "Chip8_Visited.h"
+#include <stdlib.h>
+
+//Visited set. An open addressed table of hashes, twice the capacity
+//rounded up to a power of two, probed linearly from the low bits of
+//the hash. Slots only ever go from empty to a hash, so adding needs
+//nothing but a compare and swap on the slot and no thread waits on
+//another. Empty is 0, which hash 0 can't use, so it is stored as 1.
+//Only hashes are kept: two states with the same hash are taken as
+//the same one.
+
+typedef struct visitedSet_s
+{
+	volatile uint64_t* slots;
+	uint64_t mask;
+	long count;
+} visitedSet_t;
+
+visitedSet_t* createVisitedSet( int capacity )
+{
+	visitedSet_t* set = malloc( sizeof( visitedSet_t ) );
+
+	if ( ! set )
+		return NULL;
+
+	uint64_t size = 16;
+	while ( size < (uint64_t)(capacity > 0 ? capacity : 0) * 2 )
+		size <<= 1;
+
+	set->slots = calloc( size, sizeof( uint64_t ) );
+	set->mask = size - 1;
+	set->count = 0;
+
+	if ( ! set->slots )
+	{
+		free( set );
+		return NULL;
+	}
+
+	return set;
+}
+
+bool visitState( visitedSet_t* set, uint64_t hash )
+{
+	if ( ! hash )
+		hash = 1;
+
+	for ( uint64_t probe = 0; probe <= set->mask; probe++ )
+	{
+		volatile uint64_t* slot = &set->slots[(hash + probe) & set->mask];
+		uint64_t found = atomicLoad64( slot );
+
+		if ( ! found )
+		{
+			if ( compareAndSwap64( slot, 0, hash ) )
+			{
+				atomicIncrement( &set->count );
+				return true;
+			}
+
+			//Another thread took the slot first, maybe with this hash.
+			found = atomicLoad64( slot );
+		}
+
+		if ( found == hash )
+			return false;
+	}
+
+	return true;
+}
+
+int visitedCount( const visitedSet_t* set )
+{
+	return (int)atomicLoad( &set->count );
+}
+
+void destroyVisitedSet( visitedSet_t* set )
+{
+	if ( ! set )
+		return;
+
+	free( (uint64_t*)set->slots );
+	free( set );
+}
@@ -0,0 +1,20 @@
+#pragma once
+#ifndef CHIP_8_VISITED_H
+#define CHIP_8_VISITED_H
+
+#include "Chip8.h"
+
+//Set of machine states already seen, by hashMachine. See Chip8_Visited.c.
+
+typedef struct visitedSet_s visitedSet_t;
+
+//Room for at least capacity states. Past that every state is new.
+extern visitedSet_t* createVisitedSet( int capacity );
+
+//Adds the state, and returns true when it wasn't there already. Any
+//number of threads can add to the same set at once.
+extern bool visitState( visitedSet_t* set, uint64_t hash );
+extern int visitedCount( const visitedSet_t* set );
+extern void destroyVisitedSet( visitedSet_t* set );
+
+#endif
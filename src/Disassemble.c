@@ -1,4 +1,5 @@
 #include "Chip8_Macros.h"
+#include "Chip8_Decode.h"
 #include "Diassemble.h"
 #include "Chip8.h"
 #include <assert.h>
@@ -8,32 +9,8 @@
 #include <string.h>
 
 
-typedef void (*INSTRUCTION_TXT)(uint16_t opcode, char* str );
-
-static void OP0_TXT( uint16_t opcode, char* str );
-static void OP1_TXT( uint16_t opcode, char* str );
-static void OP2_TXT( uint16_t opcode, char* str );
-static void OP3_TXT( uint16_t opcode, char* str );
-static void OP4_TXT( uint16_t opcode, char* str );
-static void OP5_TXT( uint16_t opcode, char* str );
-static void OP6_TXT( uint16_t opcode, char* str );
-static void OP7_TXT( uint16_t opcode, char* str );
-static void OP8_TXT( uint16_t opcode, char* str );
-static void OP9_TXT( uint16_t opcode, char* str );
-static void OPA_TXT( uint16_t opcode, char* str );
-static void OPB_TXT( uint16_t opcode, char* str );
-static void OPC_TXT( uint16_t opcode, char* str );
-static void OPD_TXT( uint16_t opcode, char* str );
-static void OPE_TXT( uint16_t opcode, char* str );
-static void OPF_TXT( uint16_t opcode, char* str );
-
 uint16_t* addresses = NULL;
 
-static INSTRUCTION_TXT s_instructionsTXT[16] = {
-	OP0_TXT,OP1_TXT,OP2_TXT,OP3_TXT,OP4_TXT,OP5_TXT,OP6_TXT,OP7_TXT,
-	OP8_TXT,OP9_TXT,OPA_TXT,OPB_TXT,OPC_TXT,OPD_TXT,OPE_TXT,OPF_TXT
-};
-
 typedef struct label_s
 {
 	uint16_t address;
@@ -53,6 +30,7 @@ static uint16_t* s_labels = NULL;
 
 static uint16_t tryAddLabel( uint16_t address );
 static int fetchLabel( uint16_t address );
+static void jumpText( const char* mnemonic, uint16_t address, char* str );
 
 void disassembleCode( const uint8_t* memory, const uint16_t end, const char* outFilename )
 {
@@ -143,202 +121,125 @@ uint16_t tryAddLabel( uint16_t address )
 
 void disassembleInstruction( uint16_t opcode, char* str )
 {
-	int index = getOpcodeUpper( opcode );
+	buildDecodeTable();
+	instruction_t instruction = decodeInstruction( opcode );
 
-	assert( index < 0x10 );
-	s_instructionsTXT[index]( opcode, str );
-}
-
-void OP0_TXT( uint16_t opcode, char* str )
-{
-	if ( getOpcodeN( opcode ) == 0 )
+	assert( instruction.operation < OP_COUNT );
+	switch ( instruction.operation )
 	{
+	case OP_00E0:
 		sprintf( str, "CLR" );
-	}
-	else if ( getOpcodeN( opcode ) == 0xE )
-	{
+		return;
+	case OP_00EE:
 		sprintf( str, "RET" );
-	}
-	else if ( ! s_addLabel )
-	{
-		sprintf( str, "??? (0x%04X)", opcode );
-	}
-}
-
-void OP1_TXT( uint16_t opcode, char* str )
-{
-	if ( ! s_addLabel )
-		sprintf( str, "JMP  0x%03X", getOpcodeNNN( opcode ) );
-	else
-	{
-		uint16_t address = getOpcodeNNN( opcode );
-		if ( address < 0x200 )
-			sprintf( str, "JMP  0x%03X", address);
-		else
-			sprintf( str, "JMP  label%d", tryAddLabel(address) );
-	}
-}
-
-void OP2_TXT( uint16_t opcode, char* str )
-{
-	if ( ! s_addLabel )
-		sprintf( str, "CALL 0x%03X", getOpcodeNNN( opcode ) );
-	else
-	{
-		uint16_t address = getOpcodeNNN( opcode );
-		if ( address < 0x200 )
-			sprintf( str, "CALL 0x%03X", address );
-		else
-			sprintf( str, "CALL label%d", tryAddLabel( address ) );
-	}
-}
-
-void OP3_TXT( uint16_t opcode, char* str )
-{
-	sprintf( str, "SE   V%01X, 0x%02X", getOpcodeX( opcode ), getOpcodeNN( opcode ) );
-}
-
-void OP4_TXT( uint16_t opcode, char* str )
-{
-	sprintf( str, "SNE  V%01X, 0x%02X", getOpcodeX( opcode ), getOpcodeNN( opcode ) );
-}
-
-void OP5_TXT( uint16_t opcode, char* str )
-{
-	sprintf( str, "SE  V%01X, V%01X", getOpcodeX( opcode ), getOpcodeY( opcode ) );
-}
-
-void OP6_TXT( uint16_t opcode, char* str )
-{
-	sprintf( str, "MOV  V%01X, 0x%02X", getOpcodeX( opcode ), getOpcodeNN( opcode ) );
-}
-
-void OP7_TXT( uint16_t opcode, char* str )
-{
-	sprintf( str, "ADD  V%01X, 0x%02X", getOpcodeX( opcode ), getOpcodeNN( opcode ) );
-}
-
-void OP8_TXT( uint16_t opcode, char* str )
-{
-	switch ( getOpcodeN( opcode ) )
-	{
-	case 0x0:
-		sprintf( str, "MOV  V%01X, V%01X", getOpcodeX( opcode ), getOpcodeY( opcode ) );
 		return;
-	case 0x1:
-		sprintf( str, "OR   V%01X, V%01X", getOpcodeX( opcode ), getOpcodeY( opcode ) );
+	case OP_1NNN:
+		jumpText( "JMP ", instructionNNN( instruction ), str );
 		return;
-	case 0x2:
-		sprintf( str, "AND  V%01X, V%01X", getOpcodeX( opcode ), getOpcodeY( opcode ) );
+	case OP_2NNN:
+		jumpText( "CALL", instructionNNN( instruction ), str );
 		return;
-	case 0x3:
-		sprintf( str, "XOR  V%01X, V%01X", getOpcodeX( opcode ), getOpcodeY( opcode ) );
+	case OP_3XNN:
+		sprintf( str, "SE   V%01X, 0x%02X", instruction.x, instruction.nn );
 		return;
-	case 0x4:
-		sprintf( str, "ADD  V%01X, V%01X", getOpcodeX( opcode ), getOpcodeY( opcode ) );
+	case OP_4XNN:
+		sprintf( str, "SNE  V%01X, 0x%02X", instruction.x, instruction.nn );
 		return;
-	case 0x5:
-		sprintf( str, "SUB  V%01X, V%01X", getOpcodeX( opcode ), getOpcodeY( opcode ) );
+	case OP_5XY0:
+		sprintf( str, "SE  V%01X, V%01X", instruction.x, instruction.y );
 		return;
-	case 0x6:
-		sprintf( str, "SHR  V%01X", getOpcodeX( opcode ) );
+	case OP_6XNN:
+		sprintf( str, "MOV  V%01X, 0x%02X", instruction.x, instruction.nn );
 		return;
-	case 0x7:
-		sprintf( str, "SUBO V%01X, V%01X", getOpcodeX( opcode ), getOpcodeY( opcode ) );
+	case OP_7XNN:
+		sprintf( str, "ADD  V%01X, 0x%02X", instruction.x, instruction.nn );
 		return;
-	case 0xE:
-		sprintf( str, "SHL  V%01X", getOpcodeX( opcode ) );
+	case OP_8XY0:
+		sprintf( str, "MOV  V%01X, V%01X", instruction.x, instruction.y );
 		return;
-	default:
-		if ( ! s_addLabel  )
-			sprintf( str, "??? (0x%04X)", opcode );
-	}
-}
-
-void OP9_TXT( uint16_t opcode, char* str )
-{
-	sprintf( str, "SNE  V%01X, V%01X", getOpcodeX( opcode ), getOpcodeY( opcode ) );
-}
-
-void OPA_TXT( uint16_t opcode, char* str )
-{
-	sprintf( str, "MOV  PTR, 0x%03X", getOpcodeNNN( opcode ) );
-}
-
-void OPB_TXT( uint16_t opcode, char* str )
-{
-	if ( ! s_addLabel )
-		sprintf( str, "MJMP 0x%03X", getOpcodeNNN( opcode ) );
-	else
-	{
-		uint16_t address = getOpcodeNNN( opcode );
-		if ( address < 0x200 )
-			sprintf( str, "MJMP 0x%03X", address );
-		else
-			sprintf( str, "MJMP label%d", tryAddLabel( address ) );
-	}
-}
-
-void OPC_TXT( uint16_t opcode, char* str )
-{
-	sprintf( str, "RND  V%01X, 0x%02X", getOpcodeX( opcode ), getOpcodeNN( opcode ) );
-}
-
-void OPD_TXT( uint16_t opcode, char* str )
-{
-	sprintf( str, "DRAW V%01X, V%01X, 0x%01X", getOpcodeX( opcode ), getOpcodeY( opcode ), getOpcodeN( opcode ) );
-}
-
-void OPE_TXT( uint16_t opcode, char* str )
-{
-	if ( getOpcodeN( opcode ) == 0xE )
-	{
-		sprintf( str, "SK   V%01X", getOpcodeX( opcode ) );
-	}
-	else if ( getOpcodeN( opcode ) == 0x1 )
-	{
-		sprintf( str, "SNK  V%01X", getOpcodeX( opcode ) );
-	}
-	else if ( ! s_addLabel )
-	{
-		sprintf( str, "??? (0x%04X)", opcode );
-	}
-}
-
-void OPF_TXT( uint16_t opcode, char* str )
-{
-	switch ( getOpcodeNN( opcode ) )
-	{
-	case 0x07:
-		sprintf( str, "MOV  V%01X, DLY", getOpcodeX( opcode ) );
+	case OP_8XY1:
+		sprintf( str, "OR   V%01X, V%01X", instruction.x, instruction.y );
+		return;
+	case OP_8XY2:
+		sprintf( str, "AND  V%01X, V%01X", instruction.x, instruction.y );
+		return;
+	case OP_8XY3:
+		sprintf( str, "XOR  V%01X, V%01X", instruction.x, instruction.y );
+		return;
+	case OP_8XY4:
+		sprintf( str, "ADD  V%01X, V%01X", instruction.x, instruction.y );
+		return;
+	case OP_8XY5:
+		sprintf( str, "SUB  V%01X, V%01X", instruction.x, instruction.y );
+		return;
+	case OP_8XY6:
+		sprintf( str, "SHR  V%01X", instruction.x );
+		return;
+	case OP_8XY7:
+		sprintf( str, "SUBO V%01X, V%01X", instruction.x, instruction.y );
+		return;
+	case OP_8XYE:
+		sprintf( str, "SHL  V%01X", instruction.x );
 		return;
-	case 0x0A:
-		sprintf( str, "WTK  V%01X", getOpcodeX( opcode ) );
+	case OP_9XY0:
+		sprintf( str, "SNE  V%01X, V%01X", instruction.x, instruction.y );
 		return;
-	case 0x15:
-		sprintf( str, "MOV  DLY, V%01X", getOpcodeX( opcode ) );
+	case OP_ANNN:
+		sprintf( str, "MOV  PTR, 0x%03X", instructionNNN( instruction ) );
 		return;
-	case 0x18:
-		sprintf( str, "MOV  SND, V%01X", getOpcodeX( opcode ) );
+	case OP_BNNN:
+		jumpText( "MJMP", instructionNNN( instruction ), str );
 		return;
-	case 0x1E:
-		sprintf( str, "ADD  PTR, V%01X", getOpcodeX( opcode ) );
+	case OP_CXNN:
+		sprintf( str, "RND  V%01X, 0x%02X", instruction.x, instruction.nn );
 		return;
-	case 0x29:
-		sprintf( str, "SPT  V%01X", getOpcodeX( opcode ) );
+	case OP_DXYN:
+		sprintf( str, "DRAW V%01X, V%01X, 0x%01X", instruction.x, instruction.y, instructionN( instruction ) );
 		return;
-	case 0x33:
-		sprintf( str, "BCD  V%01X", getOpcodeX( opcode ) );
+	case OP_EX9E:
+		sprintf( str, "SK   V%01X", instruction.x );
 		return;
-	case 0x55:
-		sprintf( str, "DUMP V%01X", getOpcodeX( opcode ) );
+	case OP_EXA1:
+		sprintf( str, "SNK  V%01X", instruction.x );
 		return;
-	case 0x65:
-		sprintf( str, "LOAD V%01X", getOpcodeX( opcode ) );
+	case OP_FX07:
+		sprintf( str, "MOV  V%01X, DLY", instruction.x );
+		return;
+	case OP_FX0A:
+		sprintf( str, "WTK  V%01X", instruction.x );
+		return;
+	case OP_FX15:
+		sprintf( str, "MOV  DLY, V%01X", instruction.x );
+		return;
+	case OP_FX18:
+		sprintf( str, "MOV  SND, V%01X", instruction.x );
+		return;
+	case OP_FX1E:
+		sprintf( str, "ADD  PTR, V%01X", instruction.x );
+		return;
+	case OP_FX29:
+		sprintf( str, "SPT  V%01X", instruction.x );
+		return;
+	case OP_FX33:
+		sprintf( str, "BCD  V%01X", instruction.x );
+		return;
+	case OP_FX55:
+		sprintf( str, "DUMP V%01X", instruction.x );
+		return;
+	case OP_FX65:
+		sprintf( str, "LOAD V%01X", instruction.x );
 		return;
 	default:
 		if ( ! s_addLabel )
 			sprintf( str, "??? (0x%04X)", opcode );
 	}
+}
 
-}
\ No newline at end of file
+//Jumps into the rom get a label when disassembling a whole file.
+void jumpText( const char* mnemonic, uint16_t address, char* str )
+{
+	if ( ! s_addLabel || address < 0x200 )
+		sprintf( str, "%s 0x%03X", mnemonic, address );
+	else
+		sprintf( str, "%s label%d", mnemonic, tryAddLabel( address ) );
+}
@@ -9,7 +9,10 @@
 #include "SDL_FontCache/SDL_FontCache.h"
 
 #include "Chip8.h"
+#include "Chip8_Pool.h"
+#include "Chip8_Visited.h"
 #include "Diassemble.h"
+#include "Recompile.h"
 
 
 enum
@@ -27,6 +30,8 @@ enum
 
 	INSTRUCTION_LINES = 22,
 	MEMORY_LINE_WIDTH = 8,
+
+	FRAME_MILLISECONDS = 1000 / 60,
 };
 
 static int keyCodes[] = {
@@ -85,6 +90,28 @@ static inline bool shouldBreak( chip8_t* machine );
 static inline bool isBreakpoint( uint16_t );
 static void runCommand( chip8_t* machine );
 static void changeMachine( chip8_t* machine, const char* reg, int value );
+static void benchmark( const char* filename, int instructionsPerFrame );
+static void benchmarkPool( chip8_t* machine, int instructionsPerFrame );
+static void benchmarkClones( chip8_t* machine, int instructionsPerFrame );
+static void benchmarkBatch( chip8_t* machine, int instructionsPerFrame );
+static int runFrame( chip8_t* machine, int instructionsPerFrame, runStatus_t* status );
+
+/////////////////////////////////////////////////////
+//Emulation settings
+static interpreter_t s_interpreter = INTERPRETER_TABLE;
+static uint8_t s_quirks = 0;
+static int s_benchInstructions = 0;
+static int s_poolSize = 0;
+static int s_cloneCount = 0;
+static int s_batchSize = 0;
+static uint32_t s_seed = DEFAULT_SEED;
+static uint8_t s_timerClocks = TIMER_CLOCKS;
+static const cycleCosts_t* s_cycleCosts = NULL;
+static bool s_recompile = false;
+static const char* s_outFilename = NULL;
+
+//The framebuffer a pixel to a texel, only the rows that change are uploaded.
+static SDL_Texture* s_screen = NULL;
 
 /////////////////////////////////////////////////////
 //Debug variables
@@ -131,6 +158,7 @@ static bool setupFont( SDL_Renderer* renderer )
 }
 
 static void disassemble( const char* filename );
+static void recompile( const char* filename );
 
 void readArgs( int argc, char** argv, int* instructionsPerFrame, char** filename, bool* shouldDisassemble )
 {
@@ -158,6 +186,84 @@ void readArgs( int argc, char** argv, int* instructionsPerFrame, char** filename
 				}
 			}
 		}
+		else if ( strstr( argv[i], "--interpreter=" ) != 0 || strstr( argv[i], "-i=" ) != 0 )
+		{
+			const char* value = strchr( argv[i], '=' ) + 1;
+			if ( ! findInterpreter( value, &s_interpreter ) )
+			{
+				fprintf( stderr, "WARNING: Unknown interpreter %s, using %s.\n", value, interpreterName( s_interpreter ) );
+			}
+		}
+		else if ( strstr( argv[i], "--quirks=" ) != 0 || strstr( argv[i], "-q=" ) != 0 )
+		{
+			char buffer[50] = "";
+			strncpy( buffer, strchr( argv[i], '=' ) + 1, sizeof( buffer ) - 1 );
+			for ( char* value = strtok( buffer, "," ); value; value = strtok( NULL, "," ) )
+			{
+				uint8_t quirk;
+				if ( findQuirk( value, &quirk ) )
+					s_quirks |= quirk;
+				else
+					fprintf( stderr, "WARNING: Unknown quirk %s.\n", value );
+			}
+		}
+		else if ( strstr( argv[i], "--bench=" ) != 0 )
+		{
+			if ( ! sscanf( strchr( argv[i], '=' ) + 1, "%d", &s_benchInstructions ) )
+			{
+				s_benchInstructions = 0;
+			}
+		}
+		else if ( strstr( argv[i], "--tick=" ) != 0 )
+		{
+			//Instructions per timer tick, three clocks each.
+			const char* value = strchr( argv[i], '=' ) + 1;
+			float instructions;
+			if ( strcmp( value, "frame" ) == 0 )
+				s_timerClocks = TIMER_FRAME;
+			else if ( sscanf( value, "%f", &instructions ) && instructions * 3.0f >= MIN_TIMER_CLOCKS && instructions * 3.0f <= MAX_TIMER_CLOCKS )
+				s_timerClocks = (uint8_t)(instructions * 3.0f + 0.5f);
+			else
+				fprintf( stderr, "WARNING: Invalid tick %s, use frame or 1 to 84 instructions.\n", value );
+		}
+		else if ( strstr( argv[i], "--cycles=" ) != 0 )
+		{
+			const char* value = strchr( argv[i], '=' ) + 1;
+			s_cycleCosts = findCycleCosts( value );
+			if ( ! s_cycleCosts )
+			{
+				fprintf( stderr, "WARNING: Unknown cycle costs %s, counting instructions.\n", value );
+			}
+		}
+		else if ( strstr( argv[i], "--seed=" ) != 0 )
+		{
+			if ( ! sscanf( strchr( argv[i], '=' ) + 1, "%u", &s_seed ) )
+			{
+				fprintf( stderr, "WARNING: Invalid seed %s.\n", argv[i] );
+				s_seed = DEFAULT_SEED;
+			}
+		}
+		else if ( strstr( argv[i], "--pool=" ) != 0 )
+		{
+			if ( ! sscanf( strchr( argv[i], '=' ) + 1, "%d", &s_poolSize ) )
+			{
+				s_poolSize = 0;
+			}
+		}
+		else if ( strstr( argv[i], "--clones=" ) != 0 )
+		{
+			if ( ! sscanf( strchr( argv[i], '=' ) + 1, "%d", &s_cloneCount ) )
+			{
+				s_cloneCount = 0;
+			}
+		}
+		else if ( strstr( argv[i], "--batch=" ) != 0 )
+		{
+			if ( ! sscanf( strchr( argv[i], '=' ) + 1, "%d", &s_batchSize ) )
+			{
+				s_batchSize = 0;
+			}
+		}
 		else if ( strcmp( "--help", argv[i] ) == 0 || strcmp( "-h", argv[i] ) == 0 )
 		{
 
@@ -166,6 +272,14 @@ void readArgs( int argc, char** argv, int* instructionsPerFrame, char** filename
 		{
 			*shouldDisassemble = true;
 		}
+		else if ( strcmp( "--aot", argv[i] ) == 0 )
+		{
+			s_recompile = true;
+		}
+		else if ( strcmp( "-o", argv[i] ) == 0 && i + 1 < argc )
+		{
+			s_outFilename = argv[++i];
+		}
 		else
 		{
 			if ( ! *filename )
@@ -190,6 +304,316 @@ void disassemble( const char* filename )
 	}
 }
 
+void recompile( const char* filename )
+{
+	int len;
+	uint8_t* code = readCode( filename, &len );
+
+	if ( ! code )
+		return;
+
+	char outFile[260];
+	int written;
+	if ( s_outFilename )
+		written = snprintf( outFile, sizeof( outFile ), "%s", s_outFilename );
+	else
+	{
+		//The rom's name with its extension, if it has one, swapped for .c.
+		//Only a dot in the last part of the path starts an extension.
+		const char* name = strrchr( filename, '/' );
+		name = name ? name + 1 : filename;
+		const char* dot = strrchr( name, '.' );
+		int length = dot && dot != name ? (int)(dot - filename) : (int)strlen( filename );
+		written = snprintf( outFile, sizeof( outFile ), "%.*s.c", length, filename );
+	}
+
+	if ( written < 0 || written >= (int)sizeof( outFile ) )
+	{
+		fprintf( stderr, "ERROR: Output file name too long.\n" );
+		free( code );
+		return;
+	}
+
+	recompileCode( code, len, filename, outFile, s_quirks );
+	free( code );
+}
+
+//Runs the rom headless with no input, a frame worth of
+//instructions at a time, and reports the throughput.
+void benchmark( const char* filename, int instructionsPerFrame )
+{
+	chip8_t* machine = createMachine();
+
+	if ( ! machine || ! loadRom( machine, filename ) )
+	{
+		destroyMachine( machine );
+		return;
+	}
+
+	setInterpreter( machine, s_interpreter );
+	setQuirks( machine, s_quirks );
+	seedMachine( machine, s_seed );
+	setTimerClocks( machine, s_timerClocks );
+	setCycleCosts( machine, s_cycleCosts );
+
+	if ( s_poolSize > 0 )
+	{
+		benchmarkPool( machine, instructionsPerFrame );
+		destroyMachine( machine );
+		return;
+	}
+
+	if ( s_batchSize > 0 )
+	{
+		benchmarkBatch( machine, instructionsPerFrame );
+		destroyMachine( machine );
+		return;
+	}
+
+	//Stops at the end of the frame the rom halts in.
+	int done = 0;
+	int frames = 0;
+	runStatus_t status = RUN_ACTIVE;
+	clock_t start = clock();
+	while ( done < s_benchInstructions && status != RUN_HALTED )
+	{
+		done += runFrame( machine, instructionsPerFrame, &status );
+		frames++;
+	}
+	double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf( "%s: %d instructions in %.3f s (%.1f million instructions/s).\n",
+		interpreterName( s_interpreter ), done, seconds,
+		seconds > 0.0 ? done / seconds / 1e6 : 0.0 );
+
+	if ( status == RUN_HALTED )
+		printf( "Halted at 0x%03X after %d instructions.\n", machine->cpu.pc, done );
+
+	//Modeled time against the time the host took.
+	if ( machine->costs->frame )
+	{
+		double modeled = (double)machine->cycles / machine->costs->frame / 60.0;
+		printf( "%s: %llu cycles in %d frames, %.1f s on the real machine (%.0f times real speed).\n",
+			machine->costs->name, (unsigned long long)machine->cycles, frames, modeled,
+			seconds > 0.0 ? modeled / seconds : 0.0 );
+	}
+
+	blockStats_t stats;
+	if ( getBlockStats( machine, &stats ) )
+	{
+		printf( "Blocks: %llu hits (%llu chained), %llu misses, %llu flushes, %llu compiled.\n",
+			(unsigned long long)stats.hits, (unsigned long long)stats.chained,
+			(unsigned long long)stats.misses, (unsigned long long)stats.flushes,
+			(unsigned long long)stats.compiled );
+	}
+
+	for ( int i = 0; i < FUSION_COUNT; i++ )
+	{
+		if ( machine->fusionHits[i] )
+			printf( "Fused %s: %llu hits.\n", fusionName( i ), (unsigned long long)machine->fusionHits[i] );
+	}
+
+	if ( machine->idleSkipped )
+		printf( "Idle loops: %llu instructions skipped.\n", (unsigned long long)machine->idleSkipped );
+
+	printf( "Memory: %llu bytes for the machine and its caches.\n", (unsigned long long)machineFootprint( machine ) );
+
+	if ( s_cloneCount > 0 )
+		benchmarkClones( machine, instructionsPerFrame );
+
+	destroyMachine( machine );
+}
+
+//Runs a frame worth of instructions, or of cycles when the cycle costs
+//give a speed, and returns how many instructions that was. Timers left
+//to the frontend tick once for each frame.
+int runFrame( chip8_t* machine, int instructionsPerFrame, runStatus_t* status )
+{
+	int ran = instructionsPerFrame;
+	runStatus_t result = RUN_ACTIVE;
+
+	if ( machine->costs->frame )
+		ran = runCycles( machine, machine->costs->frame, &result );
+	else
+		result = runInstructions( machine, instructionsPerFrame );
+
+	if ( machine->timerClocks == TIMER_FRAME )
+		tickTimers( machine );
+
+	if ( status )
+		*status = result;
+
+	return ran;
+}
+
+//Same as benchmark over a pool of copies of the machine, counting
+//every instruction of every machine.
+void benchmarkPool( chip8_t* machine, int instructionsPerFrame )
+{
+	clock_t created = clock();
+	pool_t* pool = createPool( machine, s_poolSize );
+	created = clock() - created;
+
+	if ( ! pool )
+	{
+		fprintf( stderr, "ERROR: Could not create a pool of %d machines.\n", s_poolSize );
+		return;
+	}
+
+	clock_t start = clock();
+	for ( int done = 0; done < s_benchInstructions; done += instructionsPerFrame )
+	{
+		runPool( pool, instructionsPerFrame );
+		if ( s_timerClocks == TIMER_FRAME )
+			tickPoolTimers( pool );
+	}
+	double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	double total = (double)s_benchInstructions * s_poolSize;
+
+	printf( "%s pool of %d: %.0f instructions in %.3f s (%.1f million instructions/s).\n",
+		interpreterName( s_interpreter ), s_poolSize, total, seconds,
+		seconds > 0.0 ? total / seconds / 1e6 : 0.0 );
+
+	poolStats_t stats;
+	getPoolStats( pool, &stats );
+	printf( "Pool: %llu instructions in lockstep, %llu one machine at a time.\n",
+		(unsigned long long)stats.lockstep, (unsigned long long)stats.scalar );
+
+	size_t bytes = poolFootprint( pool );
+	printf( "Memory: %llu bytes, %llu per machine, created in %.3f s.\n",
+		(unsigned long long)bytes, (unsigned long long)(bytes / s_poolSize),
+		(double)created / CLOCKS_PER_SEC );
+
+	destroyPool( pool );
+}
+
+//Same as benchmark over clones of the machine, once running a frame on
+//each in turn and once stepping them all with stepMany. The clones are
+//put in a shuffled order, as a search would be left with, so the next
+//one in the array is rarely the next one in memory.
+void benchmarkBatch( chip8_t* machine, int instructionsPerFrame )
+{
+	chip8_t** machines = calloc( s_batchSize, sizeof( chip8_t* ) );
+
+	if ( ! machines )
+	{
+		fprintf( stderr, "ERROR: Could not create a batch of %d machines.\n", s_batchSize );
+		return;
+	}
+
+	for ( int many = 0; many <= 1; many++ )
+	{
+		bool created = true;
+		for ( int i = 0; i < s_batchSize && created; i++ )
+			created = (machines[i] = cloneMachine( machine )) != NULL;
+
+		uint32_t random = s_seed | 1;
+		for ( int i = s_batchSize - 1; i > 0 && created; i-- )
+		{
+			random = random * 1664525u + 1013904223u;
+			int other = (random >> 8) % (i + 1);
+			chip8_t* swap = machines[i];
+			machines[i] = machines[other];
+			machines[other] = swap;
+		}
+
+		clock_t start = clock();
+		for ( int done = 0; done < s_benchInstructions && created; done += instructionsPerFrame )
+		{
+			if ( many )
+				stepMany( machines, s_batchSize, instructionsPerFrame );
+			else
+			{
+				for ( int i = 0; i < s_batchSize; i++ )
+					runInstructions( machines[i], instructionsPerFrame );
+			}
+
+			if ( s_timerClocks == TIMER_FRAME )
+			{
+				for ( int i = 0; i < s_batchSize; i++ )
+					tickTimers( machines[i] );
+			}
+		}
+		double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+		double total = (double)s_benchInstructions * s_batchSize;
+
+		for ( int i = 0; i < s_batchSize; i++ )
+		{
+			destroyMachine( machines[i] );
+			machines[i] = NULL;
+		}
+
+		if ( ! created )
+		{
+			fprintf( stderr, "ERROR: Could not create a batch of %d machines.\n", s_batchSize );
+			break;
+		}
+
+		printf( "%s batch of %d%s: %.0f instructions in %.3f s (%.1f million instructions/s).\n",
+			interpreterName( s_interpreter ), s_batchSize, many ? " with stepMany" : " one at a time",
+			total, seconds, seconds > 0.0 ? total / seconds / 1e6 : 0.0 );
+	}
+
+	free( machines );
+}
+
+//Forks the machine where the benchmark left it, as a tree search
+//would, once only dropping each clone and once running a frame on it
+//first, and reports the clones made per second.
+//Each clone in the frame pass holds down a different key, and the
+//states they end in are hashed into a visited set, as a search
+//would to drop the inputs that lead nowhere new.
+void benchmarkClones( chip8_t* machine, int instructionsPerFrame )
+{
+	visitedSet_t* visited = createVisitedSet( s_cloneCount );
+
+	if ( ! visited )
+	{
+		fprintf( stderr, "ERROR: Could not create the visited set.\n" );
+		return;
+	}
+
+	for ( int frame = 0; frame <= 1; frame++ )
+	{
+		clock_t hashing = 0;
+		clock_t start = clock();
+		for ( int i = 0; i < s_cloneCount; i++ )
+		{
+			chip8_t* clone = cloneMachine( machine );
+
+			if ( ! clone )
+			{
+				fprintf( stderr, "ERROR: Could not clone the machine.\n" );
+				destroyVisitedSet( visited );
+				return;
+			}
+
+			if ( frame )
+			{
+				writeMemory( clone, KEY_LOCATION + i % NUM_KEYS, 1 );
+				runFrame( clone, instructionsPerFrame, NULL );
+
+				clock_t hashStart = clock();
+				visitState( visited, hashMachine( clone ) );
+				hashing += clock() - hashStart;
+			}
+
+			destroyMachine( clone );
+		}
+		double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		printf( "%d clones%s in %.3f s (%.0f clones/s).\n",
+			s_cloneCount, frame ? ", each run for a frame," : "", seconds,
+			seconds > 0.0 ? s_cloneCount / seconds : 0.0 );
+
+		if ( frame )
+			printf( "%d distinct states, %.3f s hashing and looking them up.\n",
+				visitedCount( visited ), (double)hashing / CLOCKS_PER_SEC );
+	}
+
+	destroyVisitedSet( visited );
+}
+
 int main(int argc, const char** argv)
 {
 	int instructionsPerFrame = 6;
@@ -211,12 +635,29 @@ int main(int argc, const char** argv)
 		return 0;
 	}
 
+	if ( s_recompile )
+	{
+		recompile( filename );
+		return 0;
+	}
+
+	if ( s_benchInstructions > 0 )
+	{
+		benchmark( filename, instructionsPerFrame );
+		return 0;
+	}
+
 	int width = SCREEN_WIDTH;
 	int height = SCREEN_HEIGHT;
 
 
 	chip8_t* machine = createMachine();
 	chip8_t* prevMachine = NULL;
+	setInterpreter( machine, s_interpreter );
+	setQuirks( machine, s_quirks );
+	seedMachine( machine, s_seed );
+	setTimerClocks( machine, s_timerClocks );
+	setCycleCosts( machine, s_cycleCosts );
 
 	if ( s_debug )
 	{
@@ -234,7 +675,7 @@ int main(int argc, const char** argv)
 		}
 	}
 
-	if ( ! loadRom( machine->memory + 0x200, filename ) )
+	if ( ! loadRom( machine, filename ) )
 	{
 		destroyMachine( machine );
 		destroyMachine( prevMachine );
@@ -269,6 +710,18 @@ int main(int argc, const char** argv)
 		return 1;
 	}
 
+	s_screen = SDL_CreateTexture( renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, ACTUAL_SCREEN_WIDTH, ACTUAL_SCREEN_HEIGHT );
+
+	if ( ! s_screen )
+	{
+		fprintf( stderr, "ERROR: Could not create screen texture: %s\n", SDL_GetError() );
+		SDL_DestroyRenderer( renderer );
+		SDL_DestroyWindow( window );
+		destroyMachine( machine );
+		destroyMachine( prevMachine );
+		return 1;
+	}
+
 	if ( s_debug )
 	{
 		if ( ! setupFont( renderer ) )
@@ -284,8 +737,21 @@ int main(int argc, const char** argv)
 
 	SDL_Event event;
 	bool running = true;
+	bool redraw = true; //The window needs drawing whether the screen changed or not.
+	Uint32 frameStart = SDL_GetTicks();
 	while ( running )
 	{
+		//A machine waiting on FX0A only changes once a key is down, so
+		//sleep on events instead of drawing. A frame is still run every
+		//FRAME_MILLISECONDS to keep the timers ticking at 60 Hz.
+		bool waiting = ! s_debug && machine->waitingForKey;
+		if ( waiting )
+		{
+			Uint32 elapsed = SDL_GetTicks() - frameStart;
+			if ( elapsed < FRAME_MILLISECONDS )
+				SDL_WaitEventTimeout( NULL, FRAME_MILLISECONDS - elapsed );
+		}
+
 		while ( SDL_PollEvent( &event ) )
 		{
 			if ( event.type == SDL_QUIT )
@@ -293,6 +759,8 @@ int main(int argc, const char** argv)
 				running = false;
 				break;
 			}
+			else if ( event.type == SDL_WINDOWEVENT )
+				redraw = true;
 			else
 			{
 				if ( s_debug )
@@ -301,11 +769,28 @@ int main(int argc, const char** argv)
 					handleKeyPress( machine, &event );
 			}
 		}
-		SDL_RenderClear( renderer );
+
+		//A window event is drawn straight away, even mid-wait.
+		bool frameDue = ! waiting || SDL_GetTicks() - frameStart >= FRAME_MILLISECONDS;
+		if ( ! frameDue && ! redraw )
+			continue;
+
+		if ( frameDue )
+		{
+			frameStart = SDL_GetTicks();
+
+			if ( waiting )
+			{
+				runFrame( machine, instructionsPerFrame, NULL );
+				if ( machine->waitingForKey && ! redraw && ! machine->dirtyRows )
+					continue;
+			}
+		}
 
 		//Draw
 		if ( s_debug )
 		{
+			//Stepped an instruction at a time, cycle costs don't apply here.
 			for ( int i = 0; ! s_break &&  i < instructionsPerFrame; i++ )
 			{
 				doOneInstructionDebug( machine, prevMachine );
@@ -320,22 +805,36 @@ int main(int argc, const char** argv)
 				}
 					
 			}
+			if ( ! s_break && machine->timerClocks == TIMER_FRAME )
+				tickTimers( machine );
+			SDL_RenderClear( renderer );
 			drawScreenDebug( renderer, machine, prevMachine );
 		}
 		else
 		{
-			for ( int i = 0 ; i < instructionsPerFrame * 3; i++ )
-				doOneClock( machine );
+			if ( ! waiting )
+				runFrame( machine, instructionsPerFrame, NULL );
+
+			//Nothing on screen changed, so nothing is drawn or presented.
+			//Without a present to wait on vsync, sleep out the frame instead.
+			if ( ! redraw && ! machine->dirtyRows )
+			{
+				Uint32 elapsed = SDL_GetTicks() - frameStart;
+				if ( elapsed < FRAME_MILLISECONDS )
+					SDL_Delay( FRAME_MILLISECONDS - elapsed );
+				continue;
+			}
 
+			redraw = false;
+			SDL_RenderClear( renderer );
 			drawScreen( renderer, machine );
 		}
-			
-		
 
 		SDL_RenderPresent( renderer );
 	}
 
 
+	SDL_DestroyTexture( s_screen );
 	SDL_DestroyWindow( window );
 	SDL_DestroyRenderer( renderer );
 
@@ -350,7 +849,7 @@ void handleKeyPress( chip8_t* machine, SDL_Event* event )
 
 	for ( int i = 0; i < sizeof( keyCodes ) / sizeof( int ); i++ )
 	{
-		machine->memory[KEY_LOCATION + i] = keysPressed[keyCodes[i]];
+		writeMemory( machine, KEY_LOCATION + i, keysPressed[keyCodes[i]] );
 	}
 }
 
@@ -530,6 +1029,15 @@ void changeMachine( chip8_t* machine, const char* reg, int value )
 	{
 		machine->cpu.snd = value;
 	}
+	else if ( reg[0] == 'M' )
+	{
+		//Memory edit, e.g. "set M2A0 12".
+		int address;
+		if ( sscanf( reg, "M%X", &address ) && address < 0x1000 )
+		{
+			writeMemory( machine, address, value );
+		}
+	}
 	else
 	{
 		int regIdx;
@@ -540,26 +1048,30 @@ void changeMachine( chip8_t* machine, const char* reg, int value )
 	}
 }
 
+//Uploads the rows of the framebuffer that changed since the last call
+//to the screen texture, then draws the texture scaled up to the screen.
 void drawScreen( SDL_Renderer* renderer, chip8_t* machine )
 {
-	static SDL_Rect rectangle;
-	rectangle.w = PIXEL_SIZE;
-	rectangle.h = PIXEL_SIZE;
+	static uint32_t pixels[ACTUAL_SCREEN_WIDTH];
+	static SDL_Rect rectangle = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+	uint32_t rows = takeDirtyRows( machine );
 
-	for ( int i = 0; i < ACTUAL_SCREEN_WIDTH * ACTUAL_SCREEN_HEIGHT; i++ )
+	for ( int y = 0; rows; y++, rows >>= 1 )
 	{
-		rectangle.x = (i % ACTUAL_SCREEN_WIDTH) * PIXEL_SIZE;
-		rectangle.y = (i / ACTUAL_SCREEN_WIDTH) * PIXEL_SIZE;
+		if ( ! (rows & 1) )
+			continue;
 
-		uint8_t shift = (i % 8);
-		uint8_t byte = machine->memory[i/8 + 0xF00];
+		for ( int x = 0; x < ACTUAL_SCREEN_WIDTH; x++ )
+		{
+			uint8_t byte = readMemory( machine, y * 8 + x / 8 + 0xF00 );
+			pixels[x] = (byte >> (x % 8)) & 1 ? 0xFFFFFFFF : 0xFF000000;
+		}
 
-		uint8_t color = (byte >> shift) & 1;
-		SDL_SetRenderDrawColor( renderer, color * 255, color * 255, color * 255, 255 );
-		SDL_RenderFillRect( renderer, &rectangle );
+		SDL_Rect row = { 0, y, ACTUAL_SCREEN_WIDTH, 1 };
+		SDL_UpdateTexture( s_screen, &row, pixels, sizeof( pixels ) );
 	}
 
-
+	SDL_RenderCopy( renderer, s_screen, NULL, &rectangle );
 	SDL_SetRenderDrawColor( renderer, 0, 0, 0, 255 );
 }
 
@@ -734,8 +1246,8 @@ static void drawMemory( SDL_Renderer* renderer, chip8_t* machine, chip8_t* prevM
 		for ( int j = 0; j < MEMORY_LINE_WIDTH; j++ )
 		{
 			uint16_t ptr = s_memoryAddress + i * MEMORY_LINE_WIDTH + j;
-			SDL_Color color = machine->memory[ptr] == prevMachine->memory[ptr] ? white : red;
-			sprintf( value, " %02X", machine->memory[ptr] );
+			SDL_Color color = readMemory( machine, ptr ) == readMemory( prevMachine, ptr ) ? white : red;
+			sprintf( value, " %02X", readMemory( machine, ptr ) );
 			FC_DrawColor( s_fontText, renderer, x + 40 + j * 20, SCREEN_HEIGHT + 40 + i * 20, color, value );
 			
 			//strcat( buffer, value );
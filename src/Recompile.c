@@ -0,0 +1,397 @@
+#include "Chip8_Macros.h"
+#include "Chip8_Decode.h"
+#include "Diassemble.h"
+#include "Recompile.h"
+#include "Chip8.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Static recompiler. Starting from 0x200 every instruction that can be
+//reached through fall through, skips, jumps and calls is translated to a
+//labeled C statement. Returns and BNNN go through a switch on the pc,
+//and any pc the switch doesn't know (data, code built at runtime, or
+//code that was written over) is left to the interpreter.
+
+#define ROM_START 0x200
+#define LINE_SIZE 80
+#define NAME_SIZE 64
+
+//Address after the last instruction, nothing falls through to it.
+#define NO_FOLLOWING -1
+
+typedef struct recompiler_s
+{
+	FILE* out;
+	const uint8_t* code;
+	uint16_t length;
+	bool* reachable; //By offset from ROM_START.
+	bool dispatch;   //Something continues from the pc through the switch.
+	uint8_t quirks;  //Built into the translation, see setQuirks.
+} recompiler_t;
+
+static bool isCode( const recompiler_t* recompiler, uint32_t address );
+static int findSuccessors( instruction_t instruction, uint16_t address, uint16_t* next );
+static bool usesDispatch( instruction_t instruction );
+static void findReachable( recompiler_t* recompiler );
+static void makeName( const char* romFilename, char* name );
+static bool isIdleLoop( const recompiler_t* recompiler, uint16_t jump );
+static void writeNext( const recompiler_t* recompiler, uint32_t target, int following );
+static void writeInstruction( const recompiler_t* recompiler, uint16_t address, int following );
+
+bool recompileCode( const uint8_t* code, uint16_t length, const char* romFilename, const char* outFilename, uint8_t quirks )
+{
+	buildDecodeTable();
+
+	recompiler_t recompiler;
+	recompiler.code = code;
+	recompiler.length = length;
+	recompiler.dispatch = false;
+	recompiler.quirks = quirks;
+	recompiler.reachable = calloc( length ? length : 1, sizeof( bool ) );
+
+	if ( ! recompiler.reachable )
+	{
+		fprintf( stderr, "ERROR: Could not create buffer.\n" );
+		return false;
+	}
+
+	recompiler.out = fopen( outFilename, "w" );
+
+	if ( ! recompiler.out )
+	{
+		fprintf( stderr, "ERROR: Could not open %s.\n", outFilename );
+		free( recompiler.reachable );
+		return false;
+	}
+
+	findReachable( &recompiler );
+
+	char name[NAME_SIZE];
+	makeName( romFilename, name );
+
+	FILE* out = recompiler.out;
+	fprintf( out, "//Generated by c8 --aot from %s.\n", romFilename );
+	fprintf( out, "//Build with the c8 sources other than Main.c, then call %s_load\n", name );
+	fprintf( out, "//on a machine and run it as usual with runInstructions.\n\n" );
+	fprintf( out, "#include \"Chip8_Aot.h\"\n\n" );
+
+	fprintf( out, "const uint8_t %s_rom[%u] = {", name, length ? length : 1u );
+	for ( uint16_t i = 0; i < length; i++ )
+		fprintf( out, "%s0x%02X,", i % 16 ? " " : "\n\t", code[i] );
+	fprintf( out, "%s\n};\n\n", length ? "" : "\n\t0x00" );
+
+	fprintf( out, "int %s_run( chip8_t* machine, int count )\n{\n", name );
+	fprintf( out, "\tint remaining = count;\n\n" );
+	fprintf( out, "%s\tswitch ( machine->cpu.pc )\n\t{\n", recompiler.dispatch ? "dispatch:\n" : "" );
+	for ( uint16_t i = 0; i < length; i++ )
+	{
+		if ( recompiler.reachable[i] )
+			fprintf( out, "\tcase 0x%03X: goto L%03X;\n", ROM_START + i, ROM_START + i );
+	}
+	fprintf( out, "\tdefault: return count - remaining;\n\t}\n" );
+
+	int translated = 0;
+	for ( uint16_t i = 0; i < length; i++ )
+	{
+		if ( ! recompiler.reachable[i] )
+			continue;
+
+		int following = NO_FOLLOWING;
+		for ( uint16_t j = i + 1; j < length; j++ )
+		{
+			if ( recompiler.reachable[j] )
+			{
+				following = ROM_START + j;
+				break;
+			}
+		}
+
+		writeInstruction( &recompiler, ROM_START + i, following );
+		translated++;
+	}
+	fprintf( out, "}\n\n" );
+
+	fprintf( out, "void %s_load( chip8_t* machine )\n{\n", name );
+	fprintf( out, "\tloadMemory( machine, CODE_START_LOCATION, %s_rom, sizeof( %s_rom ) );\n", name, name );
+	fprintf( out, "\tsetQuirks( machine, 0x%X );\n", quirks );
+	fprintf( out, "\tsetCompiledRom( machine, %s_run, 0x%X );\n}\n", name, quirks );
+
+	fclose( out );
+	free( recompiler.reachable );
+
+	printf( "Code recompiled to %s (%d instructions).\n", outFilename, translated );
+	return true;
+}
+
+//Both bytes have to be in the rom.
+bool isCode( const recompiler_t* recompiler, uint32_t address )
+{
+	return address >= ROM_START && address + 1 < (uint32_t)ROM_START + recompiler->length
+		&& recompiler->reachable[address - ROM_START];
+}
+
+//Where execution can go next, as far as can be told without running it.
+int findSuccessors( instruction_t instruction, uint16_t address, uint16_t* next )
+{
+	switch ( instruction.operation )
+	{
+	case OP_00EE:
+	case OP_BNNN:
+		return 0;
+	case OP_1NNN:
+		next[0] = instructionNNN( instruction );
+		return 1;
+	case OP_2NNN:
+		//Where the call returns to, found again through the switch.
+		next[0] = instructionNNN( instruction );
+		next[1] = address + 2;
+		return 2;
+	case OP_3XNN:
+	case OP_4XNN:
+	case OP_5XY0:
+	case OP_9XY0:
+	case OP_EX9E:
+	case OP_EXA1:
+		next[0] = address + 2;
+		next[1] = address + 4;
+		return 2;
+	default:
+		next[0] = address + 2;
+		return 1;
+	}
+}
+
+//Instructions that leave the pc to a handler, or BNNN, and
+//carry on from wherever it ends up.
+bool usesDispatch( instruction_t instruction )
+{
+	switch ( instruction.operation )
+	{
+	case OP_00EE:
+	case OP_BNNN:
+	case OP_EX9E:
+	case OP_EXA1:
+	case OP_FX0A:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void findReachable( recompiler_t* recompiler )
+{
+	//Each instruction is visited once and adds at most two more.
+	uint16_t* pending = malloc( sizeof( uint16_t ) * (2 * (size_t)recompiler->length + 1) );
+	int count = 0;
+
+	if ( ! pending )
+		return;
+
+	pending[count++] = ROM_START;
+
+	while ( count > 0 )
+	{
+		uint16_t address = pending[--count];
+
+		if ( address < ROM_START || address + 1 >= ROM_START + recompiler->length
+			|| recompiler->reachable[address - ROM_START] )
+			continue;
+
+		recompiler->reachable[address - ROM_START] = true;
+
+		uint16_t next[2];
+		instruction_t instruction = decodeInstruction( getOpcodeRawAddress( (uint8_t*)recompiler->code, address - ROM_START ) );
+		int successors = findSuccessors( instruction, address, next );
+
+		if ( usesDispatch( instruction ) )
+			recompiler->dispatch = true;
+
+		for ( int i = 0; i < successors; i++ )
+			pending[count++] = next[i];
+	}
+
+	free( pending );
+}
+
+//File name without its directory or extension, as a C identifier.
+void makeName( const char* romFilename, char* name )
+{
+	const char* start = romFilename;
+	for ( const char* c = romFilename; *c; c++ )
+	{
+		if ( *c == '/' || *c == '\\' )
+			start = c + 1;
+	}
+
+	int length = 0;
+	if ( ! isalpha( (unsigned char)*start ) )
+	{
+		strcpy( name, "rom_" );
+		length = 4;
+	}
+
+	for ( const char* c = start; *c && *c != '.' && length < NAME_SIZE - 1; c++ )
+		name[length++] = isalnum( (unsigned char)*c ) ? *c : '_';
+
+	name[length] = '\0';
+}
+
+//The 1NNN at jump closes an idle loop, see skipIdleLoop.
+bool isIdleLoop( const recompiler_t* recompiler, uint16_t jump )
+{
+	uint16_t start = jump - 4;
+
+	if ( ! isCode( recompiler, start ) || ! isCode( recompiler, start + 2 ) )
+		return false;
+
+	instruction_t poll = decodeInstruction( getOpcodeRawAddress( (uint8_t*)recompiler->code, start - ROM_START ) );
+	instruction_t test = decodeInstruction( getOpcodeRawAddress( (uint8_t*)recompiler->code, start + 2 - ROM_START ) );
+	instruction_t self = decodeInstruction( getOpcodeRawAddress( (uint8_t*)recompiler->code, jump - ROM_START ) );
+
+	return poll.operation == OP_FX07 && (test.operation == OP_3XNN || test.operation == OP_4XNN)
+		&& test.x == poll.x && instructionNNN( self ) == start;
+}
+
+//Falls through when the target is the next label.
+void writeNext( const recompiler_t* recompiler, uint32_t target, int following )
+{
+	if ( (int)target == following )
+		return;
+
+	if ( isCode( recompiler, target ) )
+		fprintf( recompiler->out, "\tgoto L%03X;\n", target );
+	else
+		fprintf( recompiler->out, "\tEXIT( 0x%03X );\n", target );
+}
+
+void writeInstruction( const recompiler_t* recompiler, uint16_t address, int following )
+{
+	FILE* out = recompiler->out;
+	uint16_t opcode = getOpcodeRawAddress( (uint8_t*)recompiler->code, address - ROM_START );
+	instruction_t instruction = decodeInstruction( opcode );
+	uint8_t x = instruction.x;
+	uint8_t y = instruction.y;
+
+	char text[LINE_SIZE] = "";
+	disassembleInstruction( opcode, text );
+
+	fprintf( out, "\n\t//0x%03X: %s\nL%03X:\n", address, text[0] ? text : "NOP", address );
+	fprintf( out, "\tBEGIN( 0x%03X, 0x%04X );\n", address, opcode );
+
+	switch ( instruction.operation )
+	{
+	case OP_NOP:
+		break;
+	case OP_00E0:
+	case OP_CXNN:
+	case OP_DXYN:
+	case OP_FX33:
+	case OP_FX55:
+	case OP_FX65:
+		fprintf( out, "\tHANDLER( 0x%03X, 0x%04X );\n", address, opcode );
+		break;
+	case OP_00EE:
+	case OP_EX9E:
+	case OP_EXA1:
+		fprintf( out, "\tHANDLER( 0x%03X, 0x%04X );\n\tEND();\n\tDISPATCH();\n", address, opcode );
+		return;
+	case OP_FX0A:
+		fprintf( out, "\tHANDLER( 0x%03X, 0x%04X );\n\tEND();\n\tWAIT_KEY();\n", address, opcode );
+		return;
+	case OP_1NNN:
+		fprintf( out, "\tEND();\n" );
+		if ( isIdleLoop( recompiler, address ) )
+			fprintf( out, "\tSKIP_IDLE( 0x%03X );\n", instructionNNN( instruction ) );
+		writeNext( recompiler, instructionNNN( instruction ), NO_FOLLOWING );
+		return;
+	case OP_2NNN:
+		fprintf( out, "\tHANDLER( 0x%03X, 0x%04X );\n\tEND();\n", address, opcode );
+		writeNext( recompiler, instructionNNN( instruction ), NO_FOLLOWING );
+		return;
+	case OP_3XNN:
+	case OP_4XNN:
+	case OP_5XY0:
+	case OP_9XY0:
+		fprintf( out, "\t{\n" );
+		if ( instruction.operation == OP_3XNN || instruction.operation == OP_4XNN )
+			fprintf( out, "\t\tbool skip = V( 0x%X ) %s 0x%02X;\n", x, instruction.operation == OP_3XNN ? "==" : "!=", instruction.nn );
+		else
+			fprintf( out, "\t\tbool skip = V( 0x%X ) %s V( 0x%X );\n", x, instruction.operation == OP_5XY0 ? "==" : "!=", y );
+		fprintf( out, "\t\tEND();\n\t\tif ( skip )\n\t\t" );
+		writeNext( recompiler, address + 4, NO_FOLLOWING );
+		fprintf( out, "\t}\n" );
+		writeNext( recompiler, address + 2, following );
+		return;
+	case OP_6XNN:
+		fprintf( out, "\tV( 0x%X ) = 0x%02X;\n", x, instruction.nn );
+		break;
+	case OP_7XNN:
+		fprintf( out, "\tV( 0x%X ) += 0x%02X;\n", x, instruction.nn );
+		break;
+	case OP_8XY0:
+		fprintf( out, "\tV( 0x%X ) = V( 0x%X );\n", x, y );
+		break;
+	case OP_8XY1:
+		fprintf( out, "\tV( 0x%X ) |= V( 0x%X );\n", x, y );
+		break;
+	case OP_8XY2:
+		fprintf( out, "\tV( 0x%X ) &= V( 0x%X );\n", x, y );
+		break;
+	case OP_8XY3:
+		fprintf( out, "\tV( 0x%X ) ^= V( 0x%X );\n", x, y );
+		break;
+	case OP_8XY4:
+	case OP_8XY5:
+	case OP_8XY7:
+		//Flag first, then the result, the same order as the handlers.
+		fprintf( out, "\t{\n\t\tuint16_t sum = V( 0x%X ) %c V( 0x%X );\n",
+			instruction.operation == OP_8XY7 ? y : x,
+			instruction.operation == OP_8XY4 ? '+' : '-',
+			instruction.operation == OP_8XY7 ? x : y );
+		fprintf( out, "\t\tV( 0xF ) = (sum & 0xFF00u) != 0;\n\t\tV( 0x%X ) = (uint8_t)sum;\n\t}\n", x );
+		break;
+	case OP_8XY6:
+		if ( recompiler->quirks & QUIRK_SHIFT_VY )
+			fprintf( out, "\t{\n\t\tuint8_t value = V( 0x%X );\n\t\tV( 0xF ) = value & 0x1u;\n\t\tV( 0x%X ) = value >> 1;\n\t}\n", y, x );
+		else
+			fprintf( out, "\tV( 0xF ) = V( 0x%X ) & 0x1u;\n\tV( 0x%X ) >>= 1;\n", x, x );
+		break;
+	case OP_8XYE:
+		//Without the quirk the handler's flag test never passes.
+		if ( recompiler->quirks & QUIRK_SHIFT_VY )
+			fprintf( out, "\t{\n\t\tuint8_t value = V( 0x%X );\n\t\tV( 0xF ) = value >> 7;\n\t\tV( 0x%X ) = value << 1;\n\t}\n", y, x );
+		else
+			fprintf( out, "\tV( 0xF ) = 0;\n\tV( 0x%X ) <<= 1;\n", x );
+		break;
+	case OP_ANNN:
+		fprintf( out, "\tmachine->cpu.ptr = 0x%03X;\n", instructionNNN( instruction ) );
+		break;
+	case OP_BNNN:
+		fprintf( out, "\tEND();\n\tmachine->cpu.pc = 0x%03X + V( 0x%X );\n\tgoto dispatch;\n",
+			instructionNNN( instruction ), recompiler->quirks & QUIRK_JUMP_VX ? x : 0 );
+		return;
+	case OP_FX07:
+		fprintf( out, "\tV( 0x%X ) = machine->cpu.dly;\n", x );
+		break;
+	case OP_FX15:
+		fprintf( out, "\tmachine->cpu.dly = V( 0x%X );\n", x );
+		break;
+	case OP_FX18:
+		fprintf( out, "\tmachine->cpu.snd = V( 0x%X );\n", x );
+		break;
+	case OP_FX1E:
+		fprintf( out, "\tmachine->cpu.ptr += V( 0x%X );\n", x );
+		break;
+	case OP_FX29:
+		fprintf( out, "\tmachine->cpu.ptr = FONTSET_LOCATION + 5 * V( 0x%X );\n", x );
+		break;
+	default:
+		fprintf( out, "\tHANDLER( 0x%03X, 0x%04X );\n", address, opcode );
+		break;
+	}
+
+	fprintf( out, "\tEND();\n" );
+	writeNext( recompiler, address + 2, following );
+}
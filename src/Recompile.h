@@ -0,0 +1,12 @@
+#pragma once
+#ifndef RECOMPILE_H
+#define RECOMPILE_H
+#include <stdint.h>
+#include <stdbool.h>
+
+//Translates a rom to C for the runtime in Chip8_Aot.h. Functions and
+//data in the output are prefixed with the rom's file name. The quirks
+//are built into the output, which sets them when it is loaded.
+extern bool recompileCode( const uint8_t* code, uint16_t length, const char* romFilename, const char* outFilename, uint8_t quirks );
+
+#endif
@@ -0,0 +1,61 @@
+#include "Chip8.h"
+#include <stdio.h>
+
+//Machines that only differ in their CXNN generator have to hash apart,
+//whatever the timer counter is. The counter's top bit once spilled
+//into the generator's half of the hashed word and hid it. With
+//TIMER_FRAME the counter means nothing, so machines that only differ
+//in it have to hash the same.
+int main()
+{
+	int failures = 0;
+
+	for ( int counter = 0; counter < MAX_TIMER_CLOCKS; counter++ )
+	{
+		chip8_t* first = createMachine();
+		chip8_t* second = createMachine();
+
+		if ( ! first || ! second )
+		{
+			fprintf( stderr, "ERROR: Could not create machines.\n" );
+			return 1;
+		}
+
+		setTimerClocks( first, MAX_TIMER_CLOCKS );
+		setTimerClocks( second, MAX_TIMER_CLOCKS );
+		first->timerCounter = (uint8_t)counter;
+		second->timerCounter = (uint8_t)counter;
+		seedMachine( first, 1 );
+		seedMachine( second, 2 );
+
+		if ( hashMachine( first ) == hashMachine( second ) )
+		{
+			fprintf( stderr, "FAIL: random not hashed with timerCounter %d.\n", counter );
+			failures++;
+		}
+
+		seedMachine( second, 1 );
+
+		if ( hashMachine( first ) != hashMachine( second ) )
+		{
+			fprintf( stderr, "FAIL: equal machines hash apart with timerCounter %d.\n", counter );
+			failures++;
+		}
+
+		setTimerClocks( first, TIMER_FRAME );
+		setTimerClocks( second, TIMER_FRAME );
+		first->timerCounter = (uint8_t)counter;
+		second->timerCounter = (uint8_t)(counter + 1);
+
+		if ( hashMachine( first ) != hashMachine( second ) )
+		{
+			fprintf( stderr, "FAIL: timerCounter %d hashed with TIMER_FRAME.\n", counter );
+			failures++;
+		}
+
+		destroyMachine( first );
+		destroyMachine( second );
+	}
+
+	return failures != 0;
+}
@@ -0,0 +1,97 @@
+#include "Chip8.h"
+#include "Chip8_Pool.h"
+#include <stdio.h>
+
+#define POOL_MACHINES 8
+
+//With QUIRK_SHIFT_VY, 8XYE shifts VY into VX and sets VF to the bit
+//shifted out, in every interpreter and in the pool's lanes.
+static const uint8_t s_rom[] =
+{
+	0x61, 0x80, //V1 = 0x80
+	0x80, 0x1E, //V0 = V1 << 1, VF = 1
+	0x62, 0x40, //V2 = 0x40
+	0x83, 0x2E, //V3 = V2 << 1, VF = 0
+};
+
+static int checkShift( const chip8_t* machine, int step, const char* name )
+{
+	int failures = 0;
+	uint8_t flag = step == 2 ? 1 : 0;
+
+	if ( machine->cpu.reg[0xF] != flag )
+	{
+		fprintf( stderr, "FAIL: %s VF is %d after shifting out a %d.\n", name, machine->cpu.reg[0xF], flag );
+		failures++;
+	}
+
+	if ( step == 4 && (machine->cpu.reg[0x0] != 0x00 || machine->cpu.reg[0x3] != 0x80) )
+	{
+		fprintf( stderr, "FAIL: %s shifted VY into VX wrong.\n", name );
+		failures++;
+	}
+
+	return failures;
+}
+
+static chip8_t* createQuirkMachine( interpreter_t interpreter )
+{
+	chip8_t* machine = createMachine();
+
+	if ( ! machine )
+		return NULL;
+
+	setInterpreter( machine, interpreter );
+	setQuirks( machine, QUIRK_SHIFT_VY );
+	loadMemory( machine, 0x200, s_rom, sizeof( s_rom ) );
+	return machine;
+}
+
+int main()
+{
+	int failures = 0;
+
+	for ( int interpreter = 0; interpreter < INTERPRETER_COUNT; interpreter++ )
+	{
+		const char* name = interpreterName( (interpreter_t)interpreter );
+		chip8_t* machine = createQuirkMachine( (interpreter_t)interpreter );
+
+		if ( ! machine )
+		{
+			fprintf( stderr, "ERROR: Could not create a machine.\n" );
+			return 1;
+		}
+
+		for ( int step = 1; step <= 4; step++ )
+		{
+			runInstructions( machine, 1 );
+
+			if ( step % 2 == 0 )
+				failures += checkShift( machine, step, name );
+		}
+
+		destroyMachine( machine );
+
+		machine = createQuirkMachine( (interpreter_t)interpreter );
+		pool_t* pool = machine ? createPool( machine, POOL_MACHINES ) : NULL;
+		destroyMachine( machine );
+
+		if ( ! pool )
+		{
+			fprintf( stderr, "ERROR: Could not create a pool.\n" );
+			return 1;
+		}
+
+		for ( int step = 1; step <= 4; step++ )
+		{
+			runPool( pool, 1 );
+
+			for ( int i = 0; step % 2 == 0 && i < POOL_MACHINES; i++ )
+				failures += checkShift( getPoolMachine( pool, i ), step, "pool" );
+		}
+
+		destroyPool( pool );
+	}
+
+	return failures != 0;
+}